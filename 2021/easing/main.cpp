@@ -14,6 +14,10 @@
 #include <vector>
 #include <map>
 #include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+#include "tween_system.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -35,9 +39,12 @@ R"(#version 330 core
 
 uniform mat4 view;
 
-uniform vec2 center;
 uniform float size;
 
+// Per instance
+layout (location = 0) in float in_x;
+layout (location = 1) in float in_y;
+
 vec2 vertices[6] = vec2[6](
 	vec2(-1.0, -1.0),
 	vec2( 1.0, -1.0),
@@ -51,7 +58,7 @@ void main()
 {
 	vec2 v = vertices[gl_VertexID];
 
-	gl_Position = view * vec4(v * size + center, 0.0, 1.0);
+	gl_Position = view * vec4(v * size + vec2(in_x, in_y), 0.0, 1.0);
 }
 )";
 
@@ -152,12 +159,51 @@ int main() try
 	auto program = create_program(vertex_shader, fragment_shader);
 
 	GLuint view_location = glGetUniformLocation(program, "view");
-	GLuint center_location = glGetUniformLocation(program, "center");
 	GLuint size_location = glGetUniformLocation(program, "size");
 	GLuint color_location = glGetUniformLocation(program, "color");
 
+	// ELEMENTS=N animates a grid of N squares instead of the single one, all
+	// tweened together and drawn with one instanced call
+	std::size_t element_count = 1;
+	if (auto value = std::getenv("ELEMENTS"))
+		element_count = std::max(1, std::atoi(value));
+
+	int const grid_rows = std::ceil(std::sqrt(float(element_count)));
+	float const element_size = element_count == 1 ? 0.25f : 0.5f / grid_rows;
+
+	// The tweens write to object_x, where instance i's x is; y never changes
+	std::vector<float> object_x(element_count), object_y(element_count);
+	std::vector<float> object_x_end(element_count);
+	for (std::size_t i = 0; i < element_count; ++i)
+	{
+		// Rows from the bottom up, the columns filling the left half and
+		// mirrored into the right one by the tweens
+		float const row = element_count == 1 ? 0.f : (i % grid_rows + 0.5f) / grid_rows * 2.f - 1.f;
+		float const column = element_count == 1 ? 0.5f : 0.1f + 0.8f * (i / grid_rows) / grid_rows;
+		object_x[i] = -column;
+		object_x_end[i] = -column;
+		object_y[i] = row * 0.9f;
+	}
+
 	GLuint vao;
 	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+
+	GLuint x_vbo;
+	glGenBuffers(1, &x_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, x_vbo);
+	glBufferData(GL_ARRAY_BUFFER, object_x.size() * sizeof(float), object_x.data(), GL_STREAM_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, 0, nullptr);
+	glVertexAttribDivisor(0, 1);
+
+	GLuint y_vbo;
+	glGenBuffers(1, &y_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, y_vbo);
+	glBufferData(GL_ARRAY_BUFFER, object_y.size() * sizeof(float), object_y.data(), GL_STATIC_DRAW);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, 0, nullptr);
+	glVertexAttribDivisor(1, 1);
 
 	auto last_frame_start = std::chrono::high_resolution_clock::now();
 
@@ -166,12 +212,10 @@ int main() try
 	std::map<SDL_Keycode, bool> button_down;
 
 	int mode = 1;
-	bool moving = false;
 
-	float object_x = -0.5f;
-	float object_x_start = -object_x;
-	float object_x_end = object_x;
-	float object_animation_time = 0.f;
+	tween_system tweens;
+	double tween_time = 0.0;
+	std::size_t tween_frames = 0;
 
 	bool running = true;
 	while (running)
@@ -203,12 +247,19 @@ int main() try
 			if (event.key.keysym.sym == SDLK_5)
 				mode = 5;
 
-			if (event.key.keysym.sym == SDLK_SPACE && !moving)
+			if (event.key.keysym.sym == SDLK_SPACE && tweens.empty())
 			{
-				object_x_start = -object_x_start;
-				object_x_end = -object_x_end;
-				object_animation_time = 0.f;
-				moving = true;
+				// Mode 2 used to chase the end exponentially, which is the
+				// exponential easing in closed form
+				easing const easings[] = {easing::linear, easing::exponential, easing::smoothstep, easing::ease_in, easing::ease_out};
+
+				// Each row a bit slower than the one below it
+				for (std::size_t i = 0; i < element_count; ++i)
+				{
+					object_x_end[i] = -object_x_end[i];
+					float const duration = element_count == 1 ? 1.f : 0.5f + float(i % grid_rows) / grid_rows;
+					tweens.add(i, object_x[i], object_x_end[i], duration, easings[mode - 1]);
+				}
 			}
 			break;
 		case SDL_KEYUP:
@@ -224,42 +275,15 @@ int main() try
 		last_frame_start = now;
 		time += dt;
 
-		object_animation_time += dt;
-		if (object_animation_time > 1.f)
-		{
-			moving = false;
-			object_x = object_x_end;
-		}
-
-		if (moving)
+		if (!tweens.empty())
 		{
-			if (mode == 1)
-			{
-				object_x = object_x_start + (object_x_end - object_x_start) * object_animation_time;
-			}
+			auto const update_start = std::chrono::high_resolution_clock::now();
+			tweens.update(dt, object_x);
+			tween_time += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - update_start).count();
+			++tween_frames;
 
-			if (mode == 2)
-			{
-				object_x = object_x_end - (object_x_end - object_x) * std::exp(- 7.f * dt);
-			}
-
-			if (mode == 3)
-			{
-				float t = object_animation_time;
-				object_x = object_x_start + (object_x_end - object_x_start) * (3.f * t * t - 2.f * t * t * t);
-			}
-
-			if (mode == 4)
-			{
-				float t = object_animation_time;
-				object_x = object_x_start + (object_x_end - object_x_start) * t * t;
-			}
-
-			if (mode == 5)
-			{
-				float t = object_animation_time;
-				object_x = object_x_start + (object_x_end - object_x_start) * std::sqrt(t);
-			}
+			glBindBuffer(GL_ARRAY_BUFFER, x_vbo);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, object_x.size() * sizeof(float), object_x.data());
 		}
 
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -275,17 +299,19 @@ int main() try
 
 		glUseProgram(program);
 		glUniformMatrix4fv(view_location, 1, GL_TRUE, view);
-		glUniform2f(center_location, object_x, 0.f);
-		glUniform1f(size_location, 0.25f);
+		glUniform1f(size_location, element_size);
 		glUniform4f(color_location, 0.f, 0.5f, 0.f, 1.f);
 
 		glBindVertexArray(vao);
 
-		glDrawArrays(GL_TRIANGLES, 0, 6);
+		glDrawArraysInstanced(GL_TRIANGLES, 0, 6, element_count);
 
 		SDL_GL_SwapWindow(window);
 	}
 
+	if (tween_frames > 0)
+		std::cout << "Tween update: " << tween_time / tween_frames * 1e6 << " us per frame for " << element_count << " elements" << std::endl;
+
 	SDL_GL_DeleteContext(gl_context);
 	SDL_DestroyWindow(window);
 }
@@ -0,0 +1,105 @@
+#include "tween_system.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+	// value = ease(min(1, elapsed * inverse_duration)) and elapsed += dt, with
+	// ease applied to the normalized time. Kept free of branches and calls the
+	// vectorizer can't see through
+	template <typename Ease>
+	void advance(std::size_t count, float dt, float * elapsed, float const * inverse_duration, float * value, Ease ease)
+	{
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			elapsed[i] += dt;
+			value[i] = ease(std::min(1.f, elapsed[i] * inverse_duration[i]));
+		}
+	}
+
+}
+
+void tween_system::add(std::uint32_t target, float start, float end, float duration, easing e)
+{
+	auto & t = tweens_[static_cast<std::size_t>(e)];
+	t.start.push_back(start);
+	t.delta.push_back(end - start);
+	t.elapsed.push_back(0.f);
+	// A zero duration finishes on the first update
+	t.inverse_duration.push_back(duration > 0.f ? 1.f / duration : 1e30f);
+	t.target.push_back(target);
+	t.value.push_back(0.f);
+}
+
+void tween_system::update(float dt, std::span<float> output)
+{
+	for (std::size_t e = 0; e < easing_count; ++e)
+	{
+		auto & t = tweens_[e];
+		std::size_t const count = t.size();
+		if (count == 0)
+			continue;
+
+		float * elapsed = t.elapsed.data();
+		float const * inverse_duration = t.inverse_duration.data();
+		float * value = t.value.data();
+
+		switch (static_cast<easing>(e))
+		{
+		case easing::linear:
+			advance(count, dt, elapsed, inverse_duration, value, [](float x){ return x; });
+			break;
+		case easing::smoothstep:
+			advance(count, dt, elapsed, inverse_duration, value, [](float x){ return x * x * (3.f - 2.f * x); });
+			break;
+		case easing::ease_in:
+			advance(count, dt, elapsed, inverse_duration, value, [](float x){ return x * x; });
+			break;
+		case easing::ease_out:
+			advance(count, dt, elapsed, inverse_duration, value, [](float x){ return std::sqrt(x); });
+			break;
+		case easing::exponential:
+			advance(count, dt, elapsed, inverse_duration, value, [](float x){ return x < 1.f ? 1.f - std::exp(-7.f * x) : 1.f; });
+			break;
+		}
+
+		float const * start = t.start.data();
+		float const * delta = t.delta.data();
+		for (std::size_t i = 0; i < count; ++i)
+			value[i] = start[i] + delta[i] * value[i];
+
+		for (std::size_t i = 0; i < count; ++i)
+			output[t.target[i]] = value[i];
+
+		// Backwards, so that the tween swapped in has been looked at already
+		for (std::size_t i = count; i-- > 0;)
+			if (t.elapsed[i] * t.inverse_duration[i] >= 1.f)
+				t.swap_remove(i);
+	}
+}
+
+std::size_t tween_system::size() const
+{
+	std::size_t result = 0;
+	for (auto const & t : tweens_)
+		result += t.size();
+	return result;
+}
+
+void tween_system::tweens::swap_remove(std::size_t i)
+{
+	auto remove = [i](auto & v)
+	{
+		v[i] = v.back();
+		v.pop_back();
+	};
+
+	remove(start);
+	remove(delta);
+	remove(elapsed);
+	remove(inverse_duration);
+	remove(target);
+	remove(value);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+enum class easing : std::uint8_t
+{
+	linear,
+	// 3t^2 - 2t^3
+	smoothstep,
+	// t^2
+	ease_in,
+	// sqrt(t)
+	ease_out,
+	// 1 - exp(-7t), landing on the end value when the time is up
+	exponential,
+};
+
+constexpr std::size_t easing_count = 5;
+
+// Active tweens of float values, kept as structure of arrays with one set of
+// arrays per easing function, so that every update is a straight loop per
+// easing the compiler can vectorize. Tweens don't have handles: each one
+// writes to its target's slot of the output, and finished ones are swapped
+// out with the last tween of their easing
+class tween_system
+{
+public:
+	// A new tween replaces nothing: two tweens of the same target both write
+	// to it, the one updated last winning
+	void add(std::uint32_t target, float start, float end, float duration, easing e);
+
+	// Advances all the tweens by dt and writes their values to
+	// output[target]; the finished ones write their end value and are removed
+	void update(float dt, std::span<float> output);
+
+	std::size_t size() const;
+	bool empty() const { return size() == 0; }
+
+private:
+	struct tweens
+	{
+		std::vector<float> start;
+		std::vector<float> delta;
+		std::vector<float> elapsed;
+		std::vector<float> inverse_duration;
+		std::vector<std::uint32_t> target;
+		// Scratch space for the kernels
+		std::vector<float> value;
+
+		std::size_t size() const { return start.size(); }
+		void swap_remove(std::size_t i);
+	};
+
+	std::array<tweens, easing_count> tweens_;
+};
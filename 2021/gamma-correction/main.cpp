@@ -64,7 +64,6 @@ const char fragment_shader_source[] =
 R"(#version 330 core
 
 uniform sampler2D sampler;
-uniform float gamma;
 
 in vec2 texcoord;
 
@@ -72,7 +71,8 @@ layout (location = 0) out vec4 out_color;
 
 void main()
 {
-	out_color = pow(texture(sampler, texcoord), vec4(gamma));
+	// Linear; converted to sRGB on write when GL_FRAMEBUFFER_SRGB is on
+	out_color = texture(sampler, texcoord);
 }
 )";
 
@@ -130,6 +130,7 @@ int main() try
 	SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 8);
 	SDL_GL_SetAttribute(SDL_GL_BLUE_SIZE, 8);
 	SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
+	SDL_GL_SetAttribute(SDL_GL_FRAMEBUFFER_SRGB_CAPABLE, 1);
 
 	SDL_Window * window = SDL_CreateWindow("Graphics course gamma correction example",
 		SDL_WINDOWPOS_CENTERED,
@@ -164,7 +165,6 @@ int main() try
 	GLuint size_location = glGetUniformLocation(program, "size");
 	GLuint texcoord_scale_location = glGetUniformLocation(program, "texcoord_scale");
 	GLuint sampler_location = glGetUniformLocation(program, "sampler");
-	GLuint gamma_location = glGetUniformLocation(program, "gamma");
 
 	GLuint vao;
 	glGenVertexArrays(1, &vao);
@@ -179,6 +179,7 @@ int main() try
 		0, 0xffffffffu, 0xffffffffu, 0
 	};
 
+	// A linear mid-grey, which is what the checker averages to from afar
 	glBindTexture(GL_TEXTURE_2D, textures[0]);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -187,7 +188,9 @@ int main() try
 	glBindTexture(GL_TEXTURE_2D, textures[1]);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 2, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, checker_pixels);
+	// Stored as sRGB, so that filtering and the mips are computed on the
+	// decoded, linear values
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, 2, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, checker_pixels);
 	glGenerateMipmap(GL_TEXTURE_2D);
 
 	auto last_frame_start = std::chrono::high_resolution_clock::now();
@@ -238,6 +241,12 @@ int main() try
 		last_frame_start = now;
 		time += dt;
 
+		// The hardware encodes the linear output to sRGB, blending included
+		if (gamma_correction)
+			glEnable(GL_FRAMEBUFFER_SRGB);
+		else
+			glDisable(GL_FRAMEBUFFER_SRGB);
+
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		glEnable(GL_DEPTH_TEST);
 
@@ -254,7 +263,6 @@ int main() try
 		glUniform1f(size_location, 0.5f);
 		glUniform1f(texcoord_scale_location, texcoord_scale);
 		glUniform1i(sampler_location, 0);
-		glUniform1f(gamma_location, gamma_correction ? 1.f / 2.2f : 1.f);
 
 		glActiveTexture(GL_TEXTURE0);
 
@@ -8,14 +8,19 @@
 #include <GL/glew.h>
 
 #include <string_view>
+#include <algorithm>
 #include <stdexcept>
 #include <iostream>
 #include <chrono>
+#include <cstdlib>
 #include <vector>
 #include <map>
 #include <cmath>
 #include <fstream>
 #include <sstream>
+#include <filesystem>
+#include <span>
+#include <string>
 
 #define GLM_FORCE_SWIZZLE
 #define GLM_ENABLE_EXPERIMENTAL
@@ -27,6 +32,9 @@
 #include <glm/gtx/quaternion.hpp>
 #include <glm/gtx/string_cast.hpp>
 
+#include "mesh_file.hpp"
+#include "pose_runtime.hpp"
+
 std::string to_string(std::string_view str)
 {
 	return std::string(str.begin(), str.end());
@@ -49,6 +57,12 @@ uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// 0 for linear blend skinning, from three rows of a 3x4 matrix per bone;
+// 1 for dual quaternion skinning, from a rotation and a dual part per bone
+uniform int skinning_mode;
+uniform vec4 bone_matrices[192];
+uniform vec4 bone_dual_quaternions[128];
+
 layout (location = 0) in vec3 in_position;
 layout (location = 1) in vec3 in_normal;
 layout (location = 2) in ivec2 in_bone_id;
@@ -72,11 +86,49 @@ vec3 quat_rotate(vec4 q, vec3 v)
 	return quat_mult(q, quat_mult(vec4(0.0, v), quat_conj(q))).yzw;
 }
 
+// w is the scalar here, unlike in the functions above
+vec3 dual_quat_rotate(vec4 q, vec3 v)
+{
+	return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
 void main()
 {
-	gl_Position = projection * view * model * vec4(in_position, 1.0);
-	position = (model * vec4(in_position, 1.0)).xyz;
-	normal = normalize((model * vec4(in_normal, 0.0)).xyz);
+	vec3 skinned_position;
+	vec3 skinned_normal;
+
+	if (skinning_mode == 1)
+	{
+		vec4 real0 = bone_dual_quaternions[2 * in_bone_id.x];
+		vec4 dual0 = bone_dual_quaternions[2 * in_bone_id.x + 1];
+		vec4 real1 = bone_dual_quaternions[2 * in_bone_id.y];
+		vec4 dual1 = bone_dual_quaternions[2 * in_bone_id.y + 1];
+
+		// Blended along the shorter way, then brought back to unit length
+		float weight1 = dot(real0, real1) < 0.0 ? -in_bone_weight.y : in_bone_weight.y;
+		vec4 real = in_bone_weight.x * real0 + weight1 * real1;
+		vec4 dual = in_bone_weight.x * dual0 + weight1 * dual1;
+		float inverse_length = 1.0 / length(real);
+		real *= inverse_length;
+		dual *= inverse_length;
+
+		vec3 translation = 2.0 * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+		skinned_position = dual_quat_rotate(real, in_position) + translation;
+		skinned_normal = dual_quat_rotate(real, in_normal);
+	}
+	else
+	{
+		vec4 rows[3];
+		for (int i = 0; i < 3; ++i)
+			rows[i] = in_bone_weight.x * bone_matrices[3 * in_bone_id.x + i] + in_bone_weight.y * bone_matrices[3 * in_bone_id.y + i];
+
+		skinned_position = vec3(dot(rows[0], vec4(in_position, 1.0)), dot(rows[1], vec4(in_position, 1.0)), dot(rows[2], vec4(in_position, 1.0)));
+		skinned_normal = vec3(dot(rows[0].xyz, in_normal), dot(rows[1].xyz, in_normal), dot(rows[2].xyz, in_normal));
+	}
+
+	gl_Position = projection * view * model * vec4(skinned_position, 1.0);
+	position = (model * vec4(skinned_position, 1.0)).xyz;
+	normal = normalize((model * vec4(skinned_normal, 0.0)).xyz);
 }
 )";
 
@@ -155,23 +207,78 @@ struct vertex
 	std::uint8_t bone_weights[2];
 };
 
-struct bone
-{
-	std::int32_t parent_id;
-	glm::vec3 offset;
-	glm::quat rotation;
-};
+static constexpr int pose_count = 6;
 
-struct bone_pose
+// human.bin (vertex and index counts, then the arrays), bones.bin (bone count,
+// then the bones) and pose_<i>.bin (a pose per bone) are converted once into
+// human.bin.mesh, which is mapped from then on
+mesh_file load_human()
 {
-	glm::quat rotation = glm::quat(1.f, 0.f, 0.f, 0.f);
-	float scale = 1.f;
-	glm::vec3 translation = glm::vec3(0.f, 0.f, 0.f);
-};
+	std::filesystem::path const directory = PRACTICE_SOURCE_DIRECTORY;
+	auto const mesh_path = directory / "human.bin.mesh";
 
-bone_pose operator * (bone_pose const & p1, bone_pose const & p2)
-{
-	return {p1.rotation * p2.rotation, p1.scale * p2.scale, p1.scale * glm::rotate(p1.rotation, p2.translation) + p1.translation};
+	std::vector<std::filesystem::path> sources = {directory / "human.bin", directory / "bones.bin"};
+	for (int i = 0; i < pose_count; ++i)
+		sources.push_back(directory / ("pose_" + std::to_string(i) + ".bin"));
+
+	bool up_to_date = std::filesystem::exists(mesh_path);
+	for (auto const & source : sources)
+		up_to_date = up_to_date && std::filesystem::last_write_time(source) <= std::filesystem::last_write_time(mesh_path);
+
+	if (!up_to_date)
+	{
+		std::vector<vertex> vertices;
+		std::vector<std::uint32_t> indices;
+		std::vector<bone> bones;
+		std::vector<bone_pose> poses;
+
+		{
+			std::ifstream file(sources[0], std::ios::binary);
+
+			std::uint32_t vertex_count;
+			std::uint32_t index_count;
+			file.read((char*)(&vertex_count), sizeof(vertex_count));
+			file.read((char*)(&index_count), sizeof(index_count));
+			vertices.resize(vertex_count);
+			indices.resize(index_count);
+			file.read((char*)vertices.data(), vertices.size() * sizeof(vertices[0]));
+			file.read((char*)indices.data(), indices.size() * sizeof(indices[0]));
+
+			if (!file)
+				throw std::runtime_error("Failed to read " + sources[0].string());
+		}
+
+		{
+			std::ifstream file(sources[1], std::ios::binary);
+
+			std::uint32_t bone_count;
+			file.read((char*)(&bone_count), sizeof(bone_count));
+			bones.resize(bone_count);
+			file.read((char*)(bones.data()), bones.size() * sizeof(bones[0]));
+
+			if (!file)
+				throw std::runtime_error("Failed to read " + sources[1].string());
+		}
+
+		poses.resize(pose_count * bones.size());
+		for (int i = 0; i < pose_count; ++i)
+		{
+			std::ifstream file(sources[2 + i], std::ios::binary);
+			file.read((char*)(poses.data() + i * bones.size()), bones.size() * sizeof(poses[0]));
+
+			if (!file)
+				throw std::runtime_error("Failed to read " + sources[2 + i].string());
+		}
+
+		write_mesh_file(mesh_path, {
+			{mesh_section::vertices, std::span<vertex const>(vertices)},
+			{mesh_section::indices, std::span<std::uint32_t const>(indices)},
+			{mesh_section::bones, std::span<bone const>(bones)},
+			{mesh_section::poses, std::span<bone_pose const>(poses)},
+		});
+	}
+
+	return mesh_file(mesh_path);
 }
 
 int main() try
@@ -226,42 +333,50 @@ int main() try
 	GLuint light_direction_location = glGetUniformLocation(program, "light_direction");
 	GLuint light_color_location = glGetUniformLocation(program, "light_color");
 
-	std::vector<vertex> vertices;
-	std::vector<std::uint32_t> indices;
-	std::vector<bone> bones;
-	std::vector<std::vector<bone_pose>> poses(6);
+	GLuint skinning_mode_location = glGetUniformLocation(program, "skinning_mode");
+	GLuint bone_matrices_location = glGetUniformLocation(program, "bone_matrices");
+	GLuint bone_dual_quaternions_location = glGetUniformLocation(program, "bone_dual_quaternions");
 
-	{
-		std::ifstream file(PRACTICE_SOURCE_DIRECTORY "/human.bin", std::ios::binary);
-
-		std::uint32_t vertex_count;
-		std::uint32_t index_count;
-		file.read((char*)(&vertex_count), sizeof(vertex_count));
-		file.read((char*)(&index_count), sizeof(index_count));
-		vertices.resize(vertex_count);
-		indices.resize(index_count);
-		file.read((char*)vertices.data(), vertices.size() * sizeof(vertices[0]));
-		file.read((char*)indices.data(), indices.size() * sizeof(indices[0]));
-	}
+	// All read (and the vertices and indices uploaded) straight from the mapping
+	mesh_file const human = load_human();
+	auto const vertices = human.section<vertex>(mesh_section::vertices);
+	auto const indices = human.section<std::uint32_t>(mesh_section::indices);
+	auto const bones = human.section<bone>(mesh_section::bones);
 
-	{
-		std::ifstream file(PRACTICE_SOURCE_DIRECTORY "/bones.bin", std::ios::binary);
+	// Pose i's entry for bone j is poses[i * bones.size() + j]
+	auto const poses = human.section<bone_pose>(mesh_section::poses);
+	if (poses.size() != pose_count * bones.size())
+		throw std::runtime_error("human.bin.mesh has " + std::to_string(poses.size()) + " bone poses, expected " + std::to_string(pose_count * bones.size()));
 
-		std::uint32_t bone_count;
-		file.read((char*)(&bone_count), sizeof(bone_count));
-		bones.resize(bone_count);
-		file.read((char*)(bones.data()), bones.size() * sizeof(bones[0]));
-	}
+	std::cout << "Loaded " << vertices.size() << " vertices, " << indices.size() << " indices, " << bones.size() << " bones" << std::endl;
 
-	for (std::size_t i = 0; i < 6; ++i)
-	{
-		std::ifstream file(PRACTICE_SOURCE_DIRECTORY "/pose_" + std::to_string(i) + ".bin", std::ios::binary);
+	// Every character cycles through the keyframes, each with its own phase;
+	// POSE_CHARACTERS sets how many are evaluated per frame
+	pose_runtime const skeleton(bones, poses);
 
-		poses[i].resize(bones.size());
-		file.read((char*)(poses[i].data()), poses[i].size() * sizeof(poses[i][0]));
-	}
+	// What the shader's bone arrays are sized for
+	static constexpr std::size_t max_bones = 64;
+	if (skeleton.bone_count() > max_bones)
+		throw std::runtime_error("The shader takes at most " + std::to_string(max_bones) + " bones, got " + std::to_string(skeleton.bone_count()));
 
-	std::cout << "Loaded " << vertices.size() << " vertices, " << indices.size() << " indices, " << bones.size() << " bones" << std::endl;
+	// SKINNING=dq (or the S key) switches from the matrices to dual
+	// quaternions, 8 floats per bone instead of 12
+	bool dual_quaternion_skinning = false;
+	if (char const * env = std::getenv("SKINNING"))
+		dual_quaternion_skinning = std::string_view(env) == "dq";
+
+	std::size_t character_count = 1;
+	if (char const * env = std::getenv("POSE_CHARACTERS"))
+		character_count = std::max(1, std::stoi(env));
+
+	std::vector<pose_runtime::pose> character_poses(character_count, skeleton.make_pose());
+	// 3 rows per bone per character for linear blend skinning, or 2 dual
+	// quaternion halves for the other mode
+	std::vector<glm::vec4> skinning_matrices(character_count * 3 * skeleton.bone_count());
+	std::vector<glm::vec4> skinning_dual_quaternions(character_count * 2 * skeleton.bone_count());
+
+	std::chrono::duration<double, std::micro> pose_time{0};
+	std::size_t pose_frames = 0;
 
 	GLuint vao, vbo, ebo;
 	glGenVertexArrays(1, &vao);
@@ -317,6 +432,8 @@ int main() try
 			break;
 		case SDL_KEYDOWN:
 			button_down[event.key.keysym.sym] = true;
+			if (event.key.keysym.sym == SDLK_s)
+				dual_quaternion_skinning = !dual_quaternion_skinning;
 			break;
 		case SDL_KEYUP:
 			button_down[event.key.keysym.sym] = false;
@@ -331,6 +448,20 @@ int main() try
 		last_frame_start = now;
 		time += dt;
 
+		auto const pose_start = std::chrono::high_resolution_clock::now();
+		for (std::size_t c = 0; c < character_count; ++c)
+		{
+			float const phase = time + c * 0.37f;
+			std::size_t const key = std::size_t(phase) % skeleton.pose_count();
+			skeleton.blend(key, (key + 1) % skeleton.pose_count(), phase - std::floor(phase), character_poses[c]);
+			if (dual_quaternion_skinning)
+				skeleton.dual_quaternions(character_poses[c], std::span(skinning_dual_quaternions).subspan(c * 2 * skeleton.bone_count(), 2 * skeleton.bone_count()));
+			else
+				skeleton.skinning_matrices(character_poses[c], std::span(skinning_matrices).subspan(c * 3 * skeleton.bone_count(), 3 * skeleton.bone_count()));
+		}
+		pose_time += std::chrono::high_resolution_clock::now() - pose_start;
+		++pose_frames;
+
 		if (button_down[SDLK_UP])
 			camera_distance -= 3.f * dt;
 		if (button_down[SDLK_DOWN])
@@ -371,12 +502,22 @@ int main() try
 		glUniform3f(light_direction_location, 1.f / std::sqrt(3.f), 1.f / std::sqrt(3.f), 1.f / std::sqrt(3.f));
 		glUniform3f(light_color_location, 0.8f, 0.3f, 0.f);
 
+		// The first character is the one drawn
+		glUniform1i(skinning_mode_location, dual_quaternion_skinning ? 1 : 0);
+		if (dual_quaternion_skinning)
+			glUniform4fv(bone_dual_quaternions_location, 2 * skeleton.bone_count(), reinterpret_cast<float *>(skinning_dual_quaternions.data()));
+		else
+			glUniform4fv(bone_matrices_location, 3 * skeleton.bone_count(), reinterpret_cast<float *>(skinning_matrices.data()));
+
 		glBindVertexArray(vao);
 		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, nullptr);
 
 		SDL_GL_SwapWindow(window);
 	}
 
+	if (pose_frames > 0)
+		std::cout << "Pose evaluation: " << pose_time.count() / pose_frames << " us per frame for " << character_count << " characters" << std::endl;
+
 	SDL_GL_DeleteContext(gl_context);
 	SDL_DestroyWindow(window);
 }
@@ -0,0 +1,107 @@
+#include "mesh_file.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+
+namespace
+{
+
+	constexpr std::uint64_t section_alignment = 64;
+
+	struct mesh_file_header
+	{
+		static constexpr std::uint32_t current_magic = mesh_section_tag("MESH");
+		static constexpr std::uint32_t current_version = 1;
+
+		std::uint32_t magic = current_magic;
+		std::uint32_t version = current_version;
+		std::uint32_t section_count = 0;
+		std::uint32_t reserved = 0;
+	};
+
+	std::uint64_t align(std::uint64_t offset)
+	{
+		return (offset + section_alignment - 1) / section_alignment * section_alignment;
+	}
+
+}
+
+mesh_file::mesh_file(std::filesystem::path const & path)
+	: file_(path)
+{
+	mesh_file_header header;
+	if (file_.size() < sizeof(header))
+		throw std::runtime_error("Not a mesh file: " + path.string());
+	std::copy_n(file_.data(), sizeof(header), reinterpret_cast<char *>(&header));
+
+	if (header.magic != mesh_file_header::current_magic || header.version != mesh_file_header::current_version)
+		throw std::runtime_error("Not a mesh file: " + path.string());
+
+	if (file_.size() < sizeof(header) + header.section_count * sizeof(section_entry))
+		throw std::runtime_error("Corrupted mesh file: " + path.string());
+
+	sections_.resize(header.section_count);
+	std::copy_n(file_.data() + sizeof(header), sections_.size() * sizeof(section_entry), reinterpret_cast<char *>(sections_.data()));
+
+	// Every section has to be in the file, so that reading one can't go past it
+	for (auto const & s : sections_)
+	{
+		if (s.offset % section_alignment != 0 || s.element_size == 0
+			|| s.offset > file_.size() || s.count > (file_.size() - s.offset) / s.element_size)
+			throw std::runtime_error("Corrupted mesh file: " + path.string());
+	}
+}
+
+bool mesh_file::has(std::uint32_t tag) const
+{
+	return std::any_of(sections_.begin(), sections_.end(), [tag](section_entry const & s){ return s.tag == tag; });
+}
+
+mesh_file::section_entry const & mesh_file::find(std::uint32_t tag, std::size_t element_size) const
+{
+	auto it = std::find_if(sections_.begin(), sections_.end(), [tag](section_entry const & s){ return s.tag == tag; });
+
+	char const name[5] = {char(tag), char(tag >> 8), char(tag >> 16), char(tag >> 24), 0};
+	if (it == sections_.end())
+		throw std::runtime_error(std::string("Mesh file has no ") + name + " section");
+	if (it->element_size != element_size)
+		throw std::runtime_error(std::string("Mesh file's ") + name + " section has elements of " + std::to_string(it->element_size) + " bytes, expected " + std::to_string(element_size));
+
+	return *it;
+}
+
+void write_mesh_file(std::filesystem::path const & path, std::vector<mesh_file_section> const & sections)
+{
+	mesh_file_header header;
+	header.section_count = sections.size();
+
+	std::vector<mesh_file::section_entry> entries;
+	std::uint64_t offset = align(sizeof(header) + sections.size() * sizeof(mesh_file::section_entry));
+	for (auto const & s : sections)
+	{
+		entries.push_back({s.tag, s.element_size, offset, s.count});
+		offset = align(offset + s.element_size * s.count);
+	}
+
+	auto temporary_path = path;
+	temporary_path += ".tmp";
+
+	{
+		std::ofstream output(temporary_path, std::ios::binary);
+		output.write(reinterpret_cast<char const *>(&header), sizeof(header));
+		output.write(reinterpret_cast<char const *>(entries.data()), entries.size() * sizeof(entries[0]));
+
+		char const padding[section_alignment] = {};
+		for (std::size_t i = 0; i < sections.size(); ++i)
+		{
+			output.write(padding, entries[i].offset - std::uint64_t(output.tellp()));
+			output.write(static_cast<char const *>(sections[i].data), sections[i].element_size * sections[i].count);
+		}
+
+		if (!output)
+			throw std::runtime_error("Failed to write " + temporary_path.string());
+	}
+
+	std::filesystem::rename(temporary_path, path);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "mapped_file.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+constexpr std::uint32_t mesh_section_tag(char const (&name)[5])
+{
+	return std::uint32_t(std::uint8_t(name[0])) | std::uint32_t(std::uint8_t(name[1])) << 8 | std::uint32_t(std::uint8_t(name[2])) << 16 | std::uint32_t(std::uint8_t(name[3])) << 24;
+}
+
+// The sections the practices use; their layouts are the practices' structs
+namespace mesh_section
+{
+	constexpr std::uint32_t vertices = mesh_section_tag("VERT");
+	constexpr std::uint32_t indices = mesh_section_tag("INDX");
+	constexpr std::uint32_t bones = mesh_section_tag("BONE");
+	// All the poses one after another, each with an entry per bone
+	constexpr std::uint32_t poses = mesh_section_tag("POSE");
+}
+
+// A versioned file of tagged arrays, each aligned to 64 bytes. It's
+// memory-mapped, so the sections are read (or uploaded with glBufferData)
+// right from the mapping, without copies
+class mesh_file
+{
+public:
+	explicit mesh_file(std::filesystem::path const & path);
+
+	bool has(std::uint32_t tag) const;
+
+	// Throws if there's no such section or its elements aren't a T
+	template <typename T>
+	std::span<T const> section(std::uint32_t tag) const
+	{
+		auto const & s = find(tag, sizeof(T));
+		return {reinterpret_cast<T const *>(file_.data() + s.offset), static_cast<std::size_t>(s.count)};
+	}
+
+	struct section_entry
+	{
+		std::uint32_t tag;
+		std::uint32_t element_size;
+		std::uint64_t offset;
+		std::uint64_t count;
+	};
+
+private:
+	mapped_file file_;
+	std::vector<section_entry> sections_;
+
+	section_entry const & find(std::uint32_t tag, std::size_t element_size) const;
+};
+
+struct mesh_file_section
+{
+	std::uint32_t tag;
+	std::uint32_t element_size;
+	std::uint64_t count;
+	void const * data;
+
+	template <typename T>
+	mesh_file_section(std::uint32_t tag, std::span<T const> elements)
+		: tag(tag)
+		, element_size(sizeof(T))
+		, count(elements.size())
+		, data(elements.data())
+	{}
+};
+
+// Through a temporary file, so that a reader never sees a partial one
+void write_mesh_file(std::filesystem::path const & path, std::vector<mesh_file_section> const & sections);
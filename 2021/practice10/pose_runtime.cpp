@@ -0,0 +1,211 @@
+#include "pose_runtime.hpp"
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+void pose_runtime::pose::resize(std::size_t bone_count)
+{
+	for (auto * array : {&rotation_x, &rotation_y, &rotation_z, &rotation_w, &scale, &translation_x, &translation_y, &translation_z})
+		array->resize(bone_count);
+}
+
+pose_runtime::pose_runtime(std::span<bone const> bones, std::span<bone_pose const> poses)
+{
+	std::size_t const count = bones.size();
+	if (count == 0 || poses.size() % count != 0)
+		throw std::runtime_error("Expected a whole number of poses of " + std::to_string(count) + " bones, got " + std::to_string(poses.size()) + " bone poses");
+	pose_count_ = poses.size() / count;
+
+	// Breadth first from the roots, so that parents come first
+	std::vector<std::int32_t> position(count, -1);
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		if (bones[i].parent_id < 0)
+		{
+			position[i] = ids_.size();
+			ids_.push_back(i);
+		}
+	}
+	for (std::size_t next = 0; next < ids_.size(); ++next)
+	{
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			if (bones[i].parent_id == std::int32_t(ids_[next]))
+			{
+				position[i] = ids_.size();
+				ids_.push_back(i);
+			}
+		}
+	}
+	if (ids_.size() != count)
+		throw std::runtime_error("Bone hierarchy has a cycle or a bad parent id");
+
+	for (auto id : ids_)
+	{
+		auto const & b = bones[id];
+		parents_.push_back(b.parent_id < 0 ? -1 : position[b.parent_id]);
+		rest_positions_.push_back(b.offset);
+	}
+
+	keyframes_.resize(pose_count_ * count);
+	for (std::size_t k = 0; k < pose_count_; ++k)
+	{
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			auto const & p = poses[k * count + ids_[i]];
+			std::size_t const j = k * count + i;
+			keyframes_.rotation_x[j] = p.rotation.x;
+			keyframes_.rotation_y[j] = p.rotation.y;
+			keyframes_.rotation_z[j] = p.rotation.z;
+			keyframes_.rotation_w[j] = p.rotation.w;
+			keyframes_.scale[j] = p.scale;
+			keyframes_.translation_x[j] = p.translation.x;
+			keyframes_.translation_y[j] = p.translation.y;
+			keyframes_.translation_z[j] = p.translation.z;
+		}
+	}
+}
+
+pose_runtime::pose pose_runtime::make_pose() const
+{
+	pose result;
+	result.resize(bone_count());
+	return result;
+}
+
+void pose_runtime::blend(std::size_t a, std::size_t b, float t, pose & result) const
+{
+	std::size_t const n = bone_count();
+	std::size_t const a0 = a * n, b0 = b * n;
+	float const s = 1.f - t;
+
+	float const * ax = keyframes_.rotation_x.data() + a0, * bx = keyframes_.rotation_x.data() + b0;
+	float const * ay = keyframes_.rotation_y.data() + a0, * by = keyframes_.rotation_y.data() + b0;
+	float const * az = keyframes_.rotation_z.data() + a0, * bz = keyframes_.rotation_z.data() + b0;
+	float const * aw = keyframes_.rotation_w.data() + a0, * bw = keyframes_.rotation_w.data() + b0;
+	float * rx = result.rotation_x.data(), * ry = result.rotation_y.data(), * rz = result.rotation_z.data(), * rw = result.rotation_w.data();
+
+	for (std::size_t i = 0; i < n; ++i)
+	{
+		// q and -q are the same rotation; the one closer to a is taken
+		float const d = ax[i] * bx[i] + ay[i] * by[i] + az[i] * bz[i] + aw[i] * bw[i];
+		float const tb = d < 0.f ? -t : t;
+
+		float const x = ax[i] * s + bx[i] * tb;
+		float const y = ay[i] * s + by[i] * tb;
+		float const z = az[i] * s + bz[i] * tb;
+		float const w = aw[i] * s + bw[i] * tb;
+		float const inverse_length = 1.f / std::sqrt(x * x + y * y + z * z + w * w);
+
+		rx[i] = x * inverse_length;
+		ry[i] = y * inverse_length;
+		rz[i] = z * inverse_length;
+		rw[i] = w * inverse_length;
+	}
+
+	auto lerp = [&](std::vector<float> const & keys, std::vector<float> & values)
+	{
+		float const * ka = keys.data() + a0, * kb = keys.data() + b0;
+		float * v = values.data();
+		for (std::size_t i = 0; i < n; ++i)
+			v[i] = ka[i] * s + kb[i] * t;
+	};
+
+	lerp(keyframes_.scale, result.scale);
+	lerp(keyframes_.translation_x, result.translation_x);
+	lerp(keyframes_.translation_y, result.translation_y);
+	lerp(keyframes_.translation_z, result.translation_z);
+}
+
+void pose_runtime::skinning_matrices(pose const & local, std::span<glm::vec4> result) const
+{
+	std::size_t const n = bone_count();
+	if (result.size() < 3 * n)
+		throw std::runtime_error("Skinning matrix buffer is too small");
+
+	for (std::size_t i = 0; i < n; ++i)
+	{
+		float const x = local.rotation_x[i], y = local.rotation_y[i], z = local.rotation_z[i], w = local.rotation_w[i];
+		float const scale = local.scale[i];
+
+		// The rotation matrix of a unit quaternion, scaled, as rows
+		glm::vec3 const r0(1.f - 2.f * (y * y + z * z), 2.f * (x * y - w * z), 2.f * (x * z + w * y));
+		glm::vec3 const r1(2.f * (x * y + w * z), 1.f - 2.f * (x * x + z * z), 2.f * (y * z - w * x));
+		glm::vec3 const r2(2.f * (x * z - w * y), 2.f * (y * z + w * x), 1.f - 2.f * (x * x + y * y));
+
+		// About the rest position: there and back again around the pose
+		glm::vec3 const rest = rest_positions_[i];
+		glm::vec3 const translation = rest + glm::vec3(local.translation_x[i], local.translation_y[i], local.translation_z[i])
+			- scale * glm::vec3(glm::dot(r0, rest), glm::dot(r1, rest), glm::dot(r2, rest));
+
+		glm::vec4 const l[3] = {glm::vec4(r0 * scale, translation.x), glm::vec4(r1 * scale, translation.y), glm::vec4(r2 * scale, translation.z)};
+		glm::vec4 * rows = result.data() + 3 * ids_[i];
+
+		if (parents_[i] < 0)
+		{
+			rows[0] = l[0];
+			rows[1] = l[1];
+			rows[2] = l[2];
+			continue;
+		}
+
+		// The parent's rows are already there, as it comes first
+		glm::vec4 const * p = result.data() + 3 * ids_[parents_[i]];
+		for (int r = 0; r < 3; ++r)
+			rows[r] = p[r].x * l[0] + p[r].y * l[1] + p[r].z * l[2] + glm::vec4(0.f, 0.f, 0.f, p[r].w);
+	}
+}
+
+namespace
+{
+
+	// Hamilton product, w being the scalar
+	glm::vec4 quat_mult(glm::vec4 const & a, glm::vec4 const & b)
+	{
+		return {
+			a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+			a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+			a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+			a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+		};
+	}
+
+	glm::vec3 quat_rotate(glm::vec4 const & q, glm::vec3 const & v)
+	{
+		glm::vec3 const u(q.x, q.y, q.z);
+		return v + 2.f * glm::cross(u, glm::cross(u, v) + q.w * v);
+	}
+
+}
+
+void pose_runtime::dual_quaternions(pose const & local, std::span<glm::vec4> result) const
+{
+	std::size_t const n = bone_count();
+	if (result.size() < 2 * n)
+		throw std::runtime_error("Dual quaternion buffer is too small");
+
+	for (std::size_t i = 0; i < n; ++i)
+	{
+		glm::vec4 rotation(local.rotation_x[i], local.rotation_y[i], local.rotation_z[i], local.rotation_w[i]);
+
+		glm::vec3 const rest = rest_positions_[i];
+		glm::vec3 translation = rest + glm::vec3(local.translation_x[i], local.translation_y[i], local.translation_z[i]) - quat_rotate(rotation, rest);
+
+		// The parent's transform is recovered from its dual quaternion, the
+		// translation being twice the dual part times the conjugate rotation
+		if (parents_[i] >= 0)
+		{
+			glm::vec4 const * p = result.data() + 2 * ids_[parents_[i]];
+			glm::vec4 const parent_conjugate(-p[0].x, -p[0].y, -p[0].z, p[0].w);
+			glm::vec3 const parent_translation = 2.f * glm::vec3(quat_mult(p[1], parent_conjugate));
+
+			translation = quat_rotate(p[0], translation) + parent_translation;
+			rotation = quat_mult(p[0], rotation);
+		}
+
+		glm::vec4 * dq = result.data() + 2 * ids_[i];
+		dq[0] = rotation;
+		dq[1] = 0.5f * quat_mult(glm::vec4(translation, 0.f), rotation);
+	}
+}
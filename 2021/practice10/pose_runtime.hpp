@@ -0,0 +1,87 @@
+#pragma once
+
+#define GLM_FORCE_SWIZZLE
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/gtx/quaternion.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+struct bone
+{
+	std::int32_t parent_id;
+	// Rest position, in model space
+	glm::vec3 offset;
+	glm::quat rotation;
+};
+
+struct bone_pose
+{
+	glm::quat rotation = glm::quat(1.f, 0.f, 0.f, 0.f);
+	float scale = 1.f;
+	glm::vec3 translation = glm::vec3(0.f, 0.f, 0.f);
+};
+
+inline bone_pose operator * (bone_pose const & p1, bone_pose const & p2)
+{
+	return {p1.rotation * p2.rotation, p1.scale * p2.scale, p1.scale * glm::rotate(p1.rotation, p2.translation) + p1.translation};
+}
+
+// Keyframe poses of one skeleton, kept as structure of arrays so that
+// blending two of them is a handful of straight loops over all the bones the
+// compiler vectorizes. The bones are stored parents first, which lets the
+// global transforms be composed in a single pass
+class pose_runtime
+{
+public:
+	// Bone i's pose in keyframe k is poses[k * bones.size() + i], relative
+	// to its parent and applied about the bone's rest position
+	pose_runtime(std::span<bone const> bones, std::span<bone_pose const> poses);
+
+	std::size_t bone_count() const { return parents_.size(); }
+	std::size_t pose_count() const { return pose_count_; }
+
+	// A pose of every bone, in the runtime's bone order
+	struct pose
+	{
+		std::vector<float> rotation_x, rotation_y, rotation_z, rotation_w;
+		std::vector<float> scale;
+		std::vector<float> translation_x, translation_y, translation_z;
+
+		void resize(std::size_t bone_count);
+	};
+
+	// Sized for this skeleton
+	pose make_pose() const;
+
+	// Normalized lerp from keyframe a to keyframe b, the short way around
+	void blend(std::size_t a, std::size_t b, float t, pose & result) const;
+
+	// What takes a rest pose vertex to its posed place, per bone as the
+	// three rows of a 3x4 matrix, indexed by the original bone ids: ready for
+	// a uniform or texture buffer. result holds 3 * bone_count() rows. The
+	// hierarchy is composed right in there, a parent's rows being written
+	// before its children read them
+	void skinning_matrices(pose const & local, std::span<glm::vec4> result) const;
+
+	// The same transforms as unit dual quaternions, two vec4 per bone: the
+	// rotation, then the dual part, both with w as the scalar. Half the size
+	// of the matrices, but dual quaternions can't scale, so the bone scales
+	// are dropped. result holds 2 * bone_count() of them
+	void dual_quaternions(pose const & local, std::span<glm::vec4> result) const;
+
+private:
+	std::size_t pose_count_ = 0;
+	// Every keyframe one after another
+	pose keyframes_;
+
+	// In the runtime's order; a parent always comes before its children
+	std::vector<std::int32_t> parents_;
+	std::vector<glm::vec3> rest_positions_;
+	// The original id of each bone
+	std::vector<std::uint32_t> ids_;
+};
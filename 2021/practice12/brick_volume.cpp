@@ -0,0 +1,300 @@
+#include "brick_volume.hpp"
+
+#include <glm/vec4.hpp>
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <stdexcept>
+
+namespace
+{
+
+	// Each voxel the average of 2^3 of the level above
+	std::vector<std::uint8_t> downsample(std::uint8_t const * data, int size)
+	{
+		int const half = size / 2;
+		int const voxel_bytes = brick_volume::voxel_bytes;
+
+		std::vector<std::uint8_t> result(std::size_t(half) * half * half * voxel_bytes);
+		for (int z = 0; z < half; ++z)
+			for (int y = 0; y < half; ++y)
+				for (int x = 0; x < half; ++x)
+					for (int c = 0; c < voxel_bytes; ++c)
+					{
+						int sum = 0;
+						for (int i = 0; i < 8; ++i)
+						{
+							std::size_t const source = ((std::size_t(2 * z + (i >> 2)) * size + 2 * y + ((i >> 1) & 1)) * size + 2 * x + (i & 1));
+							sum += data[source * voxel_bytes + c];
+						}
+						result[((std::size_t(z) * half + y) * half + x) * voxel_bytes + c] = (sum + 4) / 8;
+					}
+		return result;
+	}
+
+	// The same dataset at another size: house256 -> house64
+	std::filesystem::path sibling_path(std::filesystem::path const & path, int size)
+	{
+		std::string name = path.filename().string();
+		while (!name.empty() && std::isdigit(static_cast<unsigned char>(name.back())))
+			name.pop_back();
+		return path.parent_path() / (name + std::to_string(size));
+	}
+
+	// Empty if there's no such file with the expected size
+	std::vector<std::uint8_t> read_level(std::filesystem::path const & path, int size)
+	{
+		std::error_code ec;
+		std::size_t const bytes = std::size_t(size) * size * size * brick_volume::voxel_bytes;
+		auto const file_bytes = std::filesystem::file_size(path, ec);
+		if (ec || file_bytes != bytes)
+			return {};
+
+		mapped_file file(path);
+		auto const data = reinterpret_cast<std::uint8_t const *>(file.data());
+		return std::vector<std::uint8_t>(data, data + bytes);
+	}
+
+	// Gribb-Hartmann: the planes are sums and differences of the matrix rows
+	bool sphere_visible(glm::mat4 const & view_projection, glm::vec3 const & center, float radius)
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			for (float sign : {-1.f, 1.f})
+			{
+				glm::vec4 plane;
+				for (int i = 0; i < 4; ++i)
+					plane[i] = view_projection[i][3] + sign * view_projection[i][axis];
+
+				float const length = glm::length(glm::vec3(plane));
+				if (glm::dot(glm::vec3(plane), center) + plane.w < -radius * length)
+					return false;
+			}
+		}
+		return true;
+	}
+
+}
+
+brick_volume::brick_volume(std::filesystem::path const & path, std::size_t cache_bytes)
+	: file_(path)
+{
+	size_ = std::lround(std::cbrt(double(file_.size() / voxel_bytes)));
+	if (std::size_t(size_) * size_ * size_ * voxel_bytes != file_.size() || size_ % brick_size != 0)
+		throw std::runtime_error(path.string() + " is not a cube of a multiple of " + std::to_string(brick_size) + " voxels");
+
+	bricks_ = size_ / brick_size;
+	int const brick_count = bricks_ * bricks_ * bricks_;
+
+	GLint max_3d_size;
+	glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &max_3d_size);
+
+	std::size_t const slot_bytes = std::size_t(slot_size) * slot_size * slot_size * voxel_bytes;
+	slots_ = std::cbrt(double(cache_bytes / slot_bytes));
+	slots_ = std::clamp(slots_, 1, std::min(bricks_, int(max_3d_size / slot_size)));
+
+	auto const data = reinterpret_cast<std::uint8_t const *>(file_.data());
+
+	// One pass over the file for the non-empty bricks
+	std::vector<bool> brick_nonzero(brick_count, false);
+	for (int z = 0; z < size_; ++z)
+	{
+		for (int y = 0; y < size_; ++y)
+		{
+			auto const row = data + (std::size_t(z) * size_ + y) * size_ * voxel_bytes;
+			std::size_t const brick_row = (std::size_t(z / brick_size) * bricks_ + y / brick_size) * bricks_;
+
+			for (int x = 0; x < size_; ++x)
+				if (row[x * voxel_bytes + 3] != 0)
+					brick_nonzero[brick_row + x / brick_size] = true;
+		}
+	}
+
+	// Filtering across the apron reaches into the neighbours, so a brick is
+	// only skipped if they are all zero as well
+	brick_empty_.assign(brick_count, true);
+	for (int z = 0; z < bricks_; ++z)
+		for (int y = 0; y < bricks_; ++y)
+			for (int x = 0; x < bricks_; ++x)
+			{
+				if (!brick_nonzero[(z * bricks_ + y) * bricks_ + x])
+					continue;
+
+				for (int bz = std::max(z - 1, 0); bz <= std::min(z + 1, bricks_ - 1); ++bz)
+					for (int by = std::max(y - 1, 0); by <= std::min(y + 1, bricks_ - 1); ++by)
+						for (int bx = std::max(x - 1, 0); bx <= std::min(x + 1, bricks_ - 1); ++bx)
+							brick_empty_[(bz * bricks_ + by) * bricks_ + bx] = false;
+			}
+
+	brick_slot_.assign(brick_count, -1);
+	slot_brick_.assign(slots_ * slots_ * slots_, -1);
+	slot_last_used_.assign(slots_ * slots_ * slots_, 0);
+
+	indirection_.assign(std::size_t(brick_count) * 4, 0);
+	for (int b = 0; b < brick_count; ++b)
+		indirection_[b * 4 + 3] = brick_empty_[b] ? empty_brick : coarse_brick;
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	glGenTextures(1, &coarse_texture_);
+	glBindTexture(GL_TEXTURE_3D, coarse_texture_);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	std::vector<std::uint8_t> level;
+	int level_size = size_;
+	for (coarse_levels_ = 0; level_size > 1; ++coarse_levels_)
+	{
+		auto next = read_level(sibling_path(path, level_size / 2), level_size / 2);
+		if (next.empty())
+			next = downsample(coarse_levels_ == 0 ? data : level.data(), level_size);
+
+		level = std::move(next);
+		level_size /= 2;
+		glTexImage3D(GL_TEXTURE_3D, coarse_levels_, GL_RGBA8, level_size, level_size, level_size, 0, GL_RGBA, GL_UNSIGNED_BYTE, level.data());
+	}
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, coarse_levels_ - 1);
+
+	int const atlas_size = slots_ * slot_size;
+	glGenTextures(1, &atlas_texture_);
+	glBindTexture(GL_TEXTURE_3D, atlas_texture_);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA8, atlas_size, atlas_size, atlas_size, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+	glGenTextures(1, &indirection_texture_);
+	glBindTexture(GL_TEXTURE_3D, indirection_texture_);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA8UI, bricks_, bricks_, bricks_, 0, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, indirection_.data());
+	indirection_dirty_ = false;
+
+	staging_.resize(slot_bytes);
+}
+
+brick_volume::~brick_volume()
+{
+	glDeleteTextures(1, &indirection_texture_);
+	glDeleteTextures(1, &atlas_texture_);
+	glDeleteTextures(1, &coarse_texture_);
+}
+
+void brick_volume::update(glm::mat4 const & view_projection, glm::vec3 const & camera_position, float pixels_per_unit, int max_uploads)
+{
+	++frame_;
+
+	float const brick_extent = 2.f / bricks_;
+	float const brick_radius = brick_extent * std::sqrt(3.f) / 2.f;
+	// Below this many pixels across, the coarse volume's first level has a voxel per pixel already
+	float const min_footprint = float(brick_size) / coarse_factor;
+
+	requests_.clear();
+	for (int z = 0; z < bricks_; ++z)
+		for (int y = 0; y < bricks_; ++y)
+			for (int x = 0; x < bricks_; ++x)
+			{
+				int const brick = (z * bricks_ + y) * bricks_ + x;
+				if (brick_empty_[brick])
+					continue;
+
+				glm::vec3 const center = glm::vec3(-1.f) + (glm::vec3(x, y, z) + 0.5f) * brick_extent;
+				if (!sphere_visible(view_projection, center, brick_radius))
+					continue;
+
+				float const distance = std::max(glm::length(center - camera_position) - brick_radius, 1e-3f);
+				float const footprint = brick_extent * pixels_per_unit / distance;
+				if (footprint <= min_footprint)
+					continue;
+
+				if (brick_slot_[brick] >= 0)
+					slot_last_used_[brick_slot_[brick]] = frame_;
+				else
+					requests_.push_back({footprint, brick});
+			}
+
+	std::sort(requests_.begin(), requests_.end(), [](request const & a, request const & b){
+		return a.footprint > b.footprint;
+	});
+
+	int uploads = 0;
+	for (auto const & r : requests_)
+	{
+		if (uploads == max_uploads)
+			break;
+
+		// Free slots have never been used, so they come first
+		auto const lru = std::min_element(slot_last_used_.begin(), slot_last_used_.end());
+		// Everything resident is in view: the rest waits until something leaves it
+		if (*lru == frame_)
+			break;
+
+		int const slot = lru - slot_last_used_.begin();
+		if (int const evicted = slot_brick_[slot]; evicted >= 0)
+		{
+			brick_slot_[evicted] = -1;
+			indirection_[evicted * 4 + 3] = coarse_brick;
+			--resident_count_;
+		}
+
+		upload(r.brick, slot);
+		++uploads;
+	}
+
+	if (indirection_dirty_)
+	{
+		indirection_dirty_ = false;
+		glBindTexture(GL_TEXTURE_3D, indirection_texture_);
+		glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, bricks_, bricks_, bricks_, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, indirection_.data());
+	}
+}
+
+void brick_volume::upload(int brick, int slot)
+{
+	int const bx = brick % bricks_;
+	int const by = (brick / bricks_) % bricks_;
+	int const bz = brick / (bricks_ * bricks_);
+
+	int const sx = slot % slots_;
+	int const sy = (slot / slots_) % slots_;
+	int const sz = slot / (slots_ * slots_);
+
+	// Straight from the mapping: only the pages of this brick are read
+	auto const data = reinterpret_cast<std::uint8_t const *>(file_.data());
+	auto out = staging_.data();
+	for (int z = 0; z < slot_size; ++z)
+	{
+		int const vz = std::clamp(bz * brick_size + z - apron, 0, size_ - 1);
+		for (int y = 0; y < slot_size; ++y)
+		{
+			int const vy = std::clamp(by * brick_size + y - apron, 0, size_ - 1);
+			auto const row = data + (std::size_t(vz) * size_ + vy) * size_ * voxel_bytes;
+			for (int x = 0; x < slot_size; ++x, out += voxel_bytes)
+				std::copy_n(row + std::clamp(bx * brick_size + x - apron, 0, size_ - 1) * voxel_bytes, voxel_bytes, out);
+		}
+	}
+
+	glBindTexture(GL_TEXTURE_3D, atlas_texture_);
+	glTexSubImage3D(GL_TEXTURE_3D, 0, sx * slot_size, sy * slot_size, sz * slot_size, slot_size, slot_size, slot_size,
+		GL_RGBA, GL_UNSIGNED_BYTE, staging_.data());
+
+	slot_brick_[slot] = brick;
+	slot_last_used_[slot] = frame_;
+	brick_slot_[brick] = slot;
+
+	indirection_[brick * 4 + 0] = sx;
+	indirection_[brick * 4 + 1] = sy;
+	indirection_[brick * 4 + 2] = sz;
+	indirection_[brick * 4 + 3] = resident_brick;
+	indirection_dirty_ = true;
+
+	++resident_count_;
+	++upload_count_;
+}
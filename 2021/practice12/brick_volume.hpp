@@ -0,0 +1,106 @@
+#pragma once
+
+#include "mapped_file.hpp"
+
+#include <GL/glew.h>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// A raw cubic RGBA8 volume (house256, bunny256, ...), with the density in
+// alpha, that is never uploaded whole. It is split into bricks, which are
+// copied from the mapped file into the slots of a fixed-size atlas texture on
+// demand, least recently used first out. An indirection texture tells the
+// shader, per brick, whether it is empty, resident (and in which slot) or only
+// in the coarse volume, which is always resident.
+//
+// The coarse volume is a mip chain from half the resolution down to 1^3. Its
+// levels are read from the files of the same name with the smaller size
+// (house128, house64) where they exist, and box filtered from the previous
+// level otherwise
+class brick_volume
+{
+public:
+	static constexpr int voxel_bytes = 4;
+	static constexpr int brick_size = 32;
+	// Voxels copied from the neighbouring bricks on each side, so that linear
+	// filtering inside a slot matches the volume's
+	static constexpr int apron = 1;
+	static constexpr int slot_size = brick_size + 2 * apron;
+	// Downsampling of the first level of the coarse volume
+	static constexpr int coarse_factor = 2;
+
+	// Alpha of the indirection texels
+	static constexpr std::uint8_t coarse_brick = 0;
+	static constexpr std::uint8_t resident_brick = 1;
+	static constexpr std::uint8_t empty_brick = 2;
+
+	// The atlas takes at most cache_bytes of video memory
+	brick_volume(std::filesystem::path const & path, std::size_t cache_bytes);
+	~brick_volume();
+
+	brick_volume(brick_volume const &) = delete;
+	brick_volume & operator = (brick_volume const &) = delete;
+
+	// Bricks of the [-1, 1]^3 cube in view whose screen footprint is larger than
+	// the coarse volume resolves are wanted at full resolution; up to
+	// max_uploads of the missing ones are streamed in, largest footprint first.
+	// pixels_per_unit is the projected size of a unit at distance 1
+	void update(glm::mat4 const & view_projection, glm::vec3 const & camera_position, float pixels_per_unit, int max_uploads);
+
+	int size() const { return size_; }
+	int bricks_per_axis() const { return bricks_; }
+	int slots_per_axis() const { return slots_; }
+	int coarse_levels() const { return coarse_levels_; }
+
+	// The full resolution voxels, straight from the mapped file
+	std::uint8_t const * voxels() const { return reinterpret_cast<std::uint8_t const *>(file_.data()); }
+
+	GLuint indirection_texture() const { return indirection_texture_; }
+	GLuint atlas_texture() const { return atlas_texture_; }
+	GLuint coarse_texture() const { return coarse_texture_; }
+
+	std::size_t resident_count() const { return resident_count_; }
+	std::size_t upload_count() const { return upload_count_; }
+
+private:
+	mapped_file file_;
+	int size_ = 0;
+	int bricks_ = 0;
+	int slots_ = 0;
+	int coarse_levels_ = 0;
+
+	// Per brick: whether its density is all zero, and its slot or -1
+	std::vector<bool> brick_empty_;
+	std::vector<int> brick_slot_;
+
+	// Per slot: its brick or -1, and the last frame it was wanted
+	std::vector<int> slot_brick_;
+	std::vector<std::uint32_t> slot_last_used_;
+
+	std::vector<std::uint8_t> indirection_;
+	bool indirection_dirty_ = true;
+
+	struct request
+	{
+		float footprint;
+		int brick;
+	};
+
+	std::vector<request> requests_;
+	std::vector<std::uint8_t> staging_;
+
+	std::uint32_t frame_ = 0;
+	std::size_t resident_count_ = 0;
+	std::size_t upload_count_ = 0;
+
+	GLuint indirection_texture_ = 0;
+	GLuint atlas_texture_ = 0;
+	GLuint coarse_texture_ = 0;
+
+	void upload(int brick, int slot);
+};
@@ -0,0 +1,457 @@
+#include "gpu_isosurface.hpp"
+#include "marching_cubes.hpp"
+
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+
+	// As in marching_cubes.cpp
+	char const tables_source[] =
+R"(
+const ivec3 corners[8] = ivec3[8](
+	ivec3(0, 0, 0), ivec3(1, 0, 0), ivec3(1, 1, 0), ivec3(0, 1, 0),
+	ivec3(0, 0, 1), ivec3(1, 0, 1), ivec3(1, 1, 1), ivec3(0, 1, 1)
+);
+
+const ivec2 edges[12] = ivec2[12](
+	ivec2(0, 1), ivec2(1, 2), ivec2(3, 2), ivec2(0, 3),
+	ivec2(4, 5), ivec2(5, 6), ivec2(7, 6), ivec2(4, 7),
+	ivec2(0, 4), ivec2(1, 5), ivec2(2, 6), ivec2(3, 7)
+);
+
+// Per case, the triangle count and then their edges
+uniform usampler2D cases;
+uniform sampler3D density;
+uniform int size;
+// Between the densities of the iso level and the one below, normalized
+uniform float threshold;
+
+int cell_case(ivec3 cell)
+{
+	int result = 0;
+	for (int i = 0; i < 8; ++i)
+		if (texelFetch(density, cell + corners[i], 0).r > threshold)
+			result |= 1 << i;
+	return result;
+}
+)";
+
+	// A triangle over the viewport per instance, into the layer of its number
+	char const slice_vertex_shader_source[] =
+R"(#version 330 core
+
+flat out int layer;
+
+void main()
+{
+	gl_Position = vec4(vec2(gl_VertexID & 1, gl_VertexID >> 1) * 4.0 - 1.0, 0.0, 1.0);
+	layer = gl_InstanceID;
+}
+)";
+
+	char const slice_geometry_shader_source[] =
+R"(#version 330 core
+
+layout (triangles) in;
+layout (triangle_strip, max_vertices = 3) out;
+
+flat in int layer[];
+
+flat out int slice;
+
+void main()
+{
+	for (int i = 0; i < 3; ++i)
+	{
+		gl_Layer = layer[0];
+		gl_Position = gl_in[i].gl_Position;
+		slice = layer[0];
+		EmitVertex();
+	}
+	EndPrimitive();
+}
+)";
+
+	char const classify_fragment_shader_source[] =
+R"(
+flat in int slice;
+
+layout (location = 0) out uint count;
+
+void main()
+{
+	ivec3 cell = ivec3(ivec2(gl_FragCoord.xy), slice);
+	if (any(equal(cell, ivec3(size - 1))))
+		count = 0u;
+	else
+		count = texelFetch(cases, ivec2(0, cell_case(cell)), 0).r;
+}
+)";
+
+	char const reduce_fragment_shader_source[] =
+R"(#version 330 core
+
+// The level below, at its lod 0
+uniform usampler3D children;
+
+flat in int slice;
+
+layout (location = 0) out uint sum;
+
+void main()
+{
+	ivec3 first = ivec3(ivec2(gl_FragCoord.xy), slice) * 2;
+	uint result = 0u;
+	for (int i = 0; i < 8; ++i)
+		result += texelFetch(children, first + ivec3(i & 1, (i >> 1) & 1, i >> 2), 0).r;
+	sum = result;
+}
+)";
+
+	char const draw_vertex_shader_source[] =
+R"(
+uniform mat4 view;
+uniform mat4 projection;
+
+uniform usampler3D counts;
+uniform usampler3D pyramid;
+uniform int levels;
+
+out vec3 position;
+out vec3 normal;
+
+uint level_count(int level, ivec3 p)
+{
+	return level == 0 ? texelFetch(counts, p, 0).r : texelFetch(pyramid, p, level - 1).r;
+}
+
+float voxel(ivec3 p)
+{
+	return texelFetch(density, clamp(p, ivec3(0), ivec3(size - 1)), 0).r;
+}
+
+// Central differences, one-sided at the volume's faces
+vec3 gradient(ivec3 p)
+{
+	vec3 result;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		ivec3 offset = ivec3(0);
+		offset[axis] = 1;
+		ivec3 above = min(p + offset, ivec3(size - 1));
+		ivec3 below = max(p - offset, ivec3(0));
+		result[axis] = (voxel(above) - voxel(below)) / float(above[axis] - below[axis]);
+	}
+	return result;
+}
+
+void main()
+{
+	uint triangle = uint(gl_VertexID / 3);
+	if (triangle >= level_count(levels, ivec3(0)))
+	{
+		position = vec3(0.0);
+		normal = vec3(0.0);
+		gl_Position = vec4(0.0, 0.0, 0.0, 1.0);
+		return;
+	}
+
+	// Into the child whose range of triangles has this one
+	ivec3 cell = ivec3(0);
+	for (int level = levels - 1; level >= 0; --level)
+	{
+		cell *= 2;
+		for (int i = 0; i < 8; ++i)
+		{
+			ivec3 child = cell + ivec3(i & 1, (i >> 1) & 1, i >> 2);
+			uint count = level_count(level, child);
+			if (triangle < count || i == 7)
+			{
+				cell = child;
+				break;
+			}
+			triangle -= count;
+		}
+	}
+
+	int edge = int(texelFetch(cases, ivec2(1 + 3 * int(triangle) + gl_VertexID % 3, cell_case(cell)), 0).r);
+	ivec3 a = cell + corners[edges[edge].x];
+	ivec3 b = cell + corners[edges[edge].y];
+	float t = (threshold - voxel(a)) / (voxel(b) - voxel(a));
+
+	// Voxel centers, as the ray marcher samples them
+	position = (mix(vec3(a), vec3(b), t) + 0.5) * (2.0 / float(size)) - 1.0;
+	normal = -mix(gradient(a), gradient(b), t);
+	gl_Position = projection * view * vec4(position, 1.0);
+}
+)";
+
+	GLuint create_shader(GLenum type, std::string const & source)
+	{
+		GLuint result = glCreateShader(type);
+		char const * data = source.c_str();
+		glShaderSource(result, 1, &data, nullptr);
+		glCompileShader(result);
+		GLint status;
+		glGetShaderiv(result, GL_COMPILE_STATUS, &status);
+		if (status != GL_TRUE)
+		{
+			GLint info_log_length;
+			glGetShaderiv(result, GL_INFO_LOG_LENGTH, &info_log_length);
+			std::string info_log(info_log_length, '\0');
+			glGetShaderInfoLog(result, info_log.size(), nullptr, info_log.data());
+			throw std::runtime_error("Shader compilation failed: " + info_log);
+		}
+		return result;
+	}
+
+	template<typename ... Shaders>
+	GLuint create_program(Shaders ... shaders)
+	{
+		GLuint result = glCreateProgram();
+		(glAttachShader(result, shaders), ...);
+		glLinkProgram(result);
+
+		GLint status;
+		glGetProgramiv(result, GL_LINK_STATUS, &status);
+		if (status != GL_TRUE)
+		{
+			GLint info_log_length;
+			glGetProgramiv(result, GL_INFO_LOG_LENGTH, &info_log_length);
+			std::string info_log(info_log_length, '\0');
+			glGetProgramInfoLog(result, info_log.size(), nullptr, info_log.data());
+			throw std::runtime_error("Program linkage failed: " + info_log);
+		}
+
+		return result;
+	}
+
+	GLuint create_volume_texture(GLenum internal_format, int size, int levels)
+	{
+		GLuint result;
+		glGenTextures(1, &result);
+		glBindTexture(GL_TEXTURE_3D, result);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+		for (int level = 0; level < levels; ++level, size /= 2)
+			glTexImage3D(GL_TEXTURE_3D, level, internal_format, size, size, size, 0,
+				internal_format == GL_R8 ? GL_RED : GL_RED_INTEGER, internal_format == GL_R32UI ? GL_UNSIGNED_INT : GL_UNSIGNED_BYTE, nullptr);
+		return result;
+	}
+
+}
+
+gpu_isosurface::gpu_isosurface(std::uint8_t const * voxels, int size, GLuint fragment_shader)
+	: size_(size)
+{
+	if (size < 2 || (size & (size - 1)) != 0)
+		throw std::runtime_error("GPU isosurfaces need a power of two volume size, not " + std::to_string(size));
+
+	while ((1 << levels_) < size)
+		++levels_;
+
+	{
+		std::vector<std::uint8_t> density(std::size_t(size) * size * size);
+		for (std::size_t i = 0; i < density.size(); ++i)
+			density[i] = voxels[i * 4 + 3];
+
+		density_texture_ = create_volume_texture(GL_R8, size, 1);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, size, size, size, GL_RED, GL_UNSIGNED_BYTE, density.data());
+	}
+
+	counts_texture_ = create_volume_texture(GL_R8UI, size, 1);
+	pyramid_texture_ = create_volume_texture(GL_R32UI, size / 2, levels_);
+
+	{
+		std::vector<std::uint8_t> cases(16 * 256, 0);
+		auto const & table = marching_cubes_cases();
+		for (int c = 0; c < 256; ++c)
+		{
+			cases[c * 16] = table[c].triangle_count;
+			for (int e = 0; e < 3 * table[c].triangle_count; ++e)
+				cases[c * 16 + 1 + e] = table[c].edges[e];
+		}
+
+		glGenTextures(1, &cases_texture_);
+		glBindTexture(GL_TEXTURE_2D, cases_texture_);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, 16, 256, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, cases.data());
+	}
+
+	std::string const version = "#version 330 core\n";
+	GLuint const slice_vertex_shader = create_shader(GL_VERTEX_SHADER, slice_vertex_shader_source);
+	GLuint const slice_geometry_shader = create_shader(GL_GEOMETRY_SHADER, slice_geometry_shader_source);
+	GLuint const classify_fragment_shader = create_shader(GL_FRAGMENT_SHADER, version + tables_source + classify_fragment_shader_source);
+	GLuint const reduce_fragment_shader = create_shader(GL_FRAGMENT_SHADER, reduce_fragment_shader_source);
+	GLuint const draw_vertex_shader = create_shader(GL_VERTEX_SHADER, version + tables_source + draw_vertex_shader_source);
+	shaders_ = {slice_vertex_shader, slice_geometry_shader, classify_fragment_shader, reduce_fragment_shader, draw_vertex_shader};
+
+	classify_program_ = create_program(slice_vertex_shader, slice_geometry_shader, classify_fragment_shader);
+	reduce_program_ = create_program(slice_vertex_shader, slice_geometry_shader, reduce_fragment_shader);
+	draw_program_ = create_program(draw_vertex_shader, fragment_shader);
+
+	// Units 0 to 3: the density, the cases, the counts and the pyramid
+	glUseProgram(classify_program_);
+	glUniform1i(glGetUniformLocation(classify_program_, "density"), 0);
+	glUniform1i(glGetUniformLocation(classify_program_, "cases"), 1);
+	glUniform1i(glGetUniformLocation(classify_program_, "size"), size_);
+	classify_threshold_location_ = glGetUniformLocation(classify_program_, "threshold");
+
+	glUseProgram(reduce_program_);
+	glUniform1i(glGetUniformLocation(reduce_program_, "children"), 2);
+
+	glUseProgram(draw_program_);
+	glUniform1i(glGetUniformLocation(draw_program_, "density"), 0);
+	glUniform1i(glGetUniformLocation(draw_program_, "cases"), 1);
+	glUniform1i(glGetUniformLocation(draw_program_, "counts"), 2);
+	glUniform1i(glGetUniformLocation(draw_program_, "pyramid"), 3);
+	glUniform1i(glGetUniformLocation(draw_program_, "size"), size_);
+	glUniform1i(glGetUniformLocation(draw_program_, "levels"), levels_);
+	draw_threshold_location_ = glGetUniformLocation(draw_program_, "threshold");
+	glUseProgram(0);
+
+	glGenFramebuffers(1, &framebuffer_);
+	glGenVertexArrays(1, &vao_);
+
+	glGenBuffers(1, &readback_buffer_);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback_buffer_);
+	glBufferData(GL_PIXEL_PACK_BUFFER, sizeof(GLuint), nullptr, GL_STREAM_READ);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+gpu_isosurface::~gpu_isosurface()
+{
+	if (readback_fence_)
+		glDeleteSync(readback_fence_);
+	glDeleteBuffers(1, &readback_buffer_);
+	glDeleteVertexArrays(1, &vao_);
+	glDeleteFramebuffers(1, &framebuffer_);
+	glDeleteProgram(draw_program_);
+	glDeleteProgram(reduce_program_);
+	glDeleteProgram(classify_program_);
+	for (GLuint shader : shaders_)
+		glDeleteShader(shader);
+	glDeleteTextures(1, &pyramid_texture_);
+	glDeleteTextures(1, &counts_texture_);
+	glDeleteTextures(1, &cases_texture_);
+	glDeleteTextures(1, &density_texture_);
+}
+
+void gpu_isosurface::update(std::uint8_t iso)
+{
+	if (iso != iso_)
+	{
+		iso_ = iso;
+		float const threshold = (iso - 0.5f) / 255.f;
+
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		glDisable(GL_CULL_FACE);
+		glDisable(GL_DEPTH_TEST);
+		glDisable(GL_BLEND);
+
+		glBindVertexArray(vao_);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer_);
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_3D, density_texture_);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, cases_texture_);
+
+		glUseProgram(classify_program_);
+		glUniform1f(classify_threshold_location_, threshold);
+		glFramebufferTexture(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, counts_texture_, 0);
+		glViewport(0, 0, size_, size_);
+		glDrawArraysInstanced(GL_TRIANGLES, 0, 3, size_);
+
+		// Each level from the one below, which alone is in the texture's
+		// mip range so that it's never read while being drawn
+		glUseProgram(reduce_program_);
+		glActiveTexture(GL_TEXTURE2);
+		for (int level = 1; level <= levels_; ++level)
+		{
+			if (level == 1)
+				glBindTexture(GL_TEXTURE_3D, counts_texture_);
+			else
+			{
+				glBindTexture(GL_TEXTURE_3D, pyramid_texture_);
+				glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_BASE_LEVEL, level - 2);
+				glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, level - 2);
+			}
+
+			int const level_size = size_ >> level;
+			glFramebufferTexture(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, pyramid_texture_, level - 1);
+			glViewport(0, 0, level_size, level_size);
+			glDrawArraysInstanced(GL_TRIANGLES, 0, 3, level_size);
+		}
+
+		glBindTexture(GL_TEXTURE_3D, pyramid_texture_);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, levels_ - 1);
+		glActiveTexture(GL_TEXTURE0);
+
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+		glUseProgram(draw_program_);
+		glUniform1f(draw_threshold_location_, threshold);
+
+		readback_wanted_ = true;
+	}
+
+	if (readback_fence_)
+	{
+		GLenum const status = glClientWaitSync(readback_fence_, 0, 0);
+		if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+		{
+			glDeleteSync(readback_fence_);
+			readback_fence_ = nullptr;
+
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, readback_buffer_);
+			if (auto const count = static_cast<GLuint const *>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, sizeof(GLuint), GL_MAP_READ_BIT)))
+			{
+				triangle_count_ = *count;
+				glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			}
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		}
+	}
+
+	// The top of the pyramid, one read at a time
+	if (readback_wanted_ && !readback_fence_)
+	{
+		readback_wanted_ = false;
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer_);
+		glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, pyramid_texture_, levels_ - 1, 0);
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readback_buffer_);
+		glReadPixels(0, 0, 1, 1, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+		readback_fence_ = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+}
+
+void gpu_isosurface::draw() const
+{
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_3D, density_texture_);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, cases_texture_);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_3D, counts_texture_);
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_3D, pyramid_texture_);
+	glActiveTexture(GL_TEXTURE0);
+
+	std::size_t const triangles = triangle_count_ + triangle_count_ / 4 + 1024;
+	glBindVertexArray(vao_);
+	glDrawArrays(GL_TRIANGLES, 0, 3 * triangles);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Marching cubes on the GPU by a HistoPyramid, fast enough to redo every
+// frame while the iso level is scrubbed. A layered pass counts each cell's
+// triangles into a 3D texture, a pyramid of 3D textures halving down to one
+// texel sums them eight at a time, and the draw's vertex shader finds its
+// triangle by descending the pyramid from gl_VertexID, then computes its
+// vertex from the density the same way extract_isosurface does. Only the
+// density goes to the GPU, as R8 at full resolution.
+//
+// The draw needs the triangle count, which is read back through a pixel
+// pack buffer without waiting, so for the frame or two after a change it
+// draws the last known count with a quarter to spare, the vertex shader
+// collapsing the triangles past the real one
+class gpu_isosurface
+{
+public:
+	// A cubic RGBA8 volume of a power of two size, density in alpha; the
+	// program is linked with fragment_shader, which gets the position in the
+	// [-1, 1]^3 cube and the normal
+	gpu_isosurface(std::uint8_t const * voxels, int size, GLuint fragment_shader);
+	~gpu_isosurface();
+
+	gpu_isosurface(gpu_isosurface const &) = delete;
+	gpu_isosurface & operator = (gpu_isosurface const &) = delete;
+
+	// Rebuilds the pyramid if the level changed and collects the count read
+	// back. Disables face culling, depth testing and blending, and rebinds
+	// the framebuffer to 0, keeping the viewport
+	void update(std::uint8_t iso);
+
+	// With view and projection uniforms for the vertex shader; the fragment
+	// shader's uniforms are set on it by the caller, with texture units from
+	// 4 on left to it
+	GLuint program() const { return draw_program_; }
+
+	// With program() in use
+	void draw() const;
+
+	// As last read back
+	std::size_t triangle_count() const { return triangle_count_; }
+
+private:
+	int size_ = 0;
+	// Above the base, down to a single texel
+	int levels_ = 0;
+	int iso_ = -1;
+
+	GLuint density_texture_ = 0;
+	GLuint cases_texture_ = 0;
+	// Triangles per cell, R8UI
+	GLuint counts_texture_ = 0;
+	// Level l of the pyramid, R32UI, at its mip level l - 1
+	GLuint pyramid_texture_ = 0;
+
+	GLuint framebuffer_ = 0;
+	GLuint vao_ = 0;
+	GLuint classify_program_ = 0;
+	GLuint reduce_program_ = 0;
+	GLuint draw_program_ = 0;
+	std::vector<GLuint> shaders_;
+
+	GLuint classify_threshold_location_ = 0;
+	GLuint draw_threshold_location_ = 0;
+
+	GLuint readback_buffer_ = 0;
+	GLsync readback_fence_ = nullptr;
+	bool readback_wanted_ = false;
+	std::size_t triangle_count_ = 0;
+};
@@ -0,0 +1,208 @@
+#include "job_system.hpp"
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+job_system::job_system(std::size_t thread_count)
+{
+	for (std::size_t t = 0; t < thread_count; ++t)
+		queues_.push_back(std::make_unique<queue>());
+
+	for (std::size_t t = 1; t < thread_count; ++t)
+		threads_.emplace_back([this, t]{ work(t); });
+}
+
+job_system::~job_system()
+{
+	{
+		std::lock_guard lock(mutex_);
+		stop_ = true;
+	}
+	wake_.notify_all();
+
+	for (auto & thread : threads_)
+		thread.join();
+}
+
+job_system::task_id job_system::add(char const * name, std::function<void()> job, std::span<task_id const> dependencies)
+{
+	task_id const id = tasks_.size();
+	auto & t = tasks_.emplace_back();
+	t.name = name;
+	t.job = std::move(job);
+	t.dependency_count = dependencies.size();
+	t.waiting.store(dependencies.size(), std::memory_order_relaxed);
+
+	for (auto dependency : dependencies)
+	{
+		if (dependency >= id)
+			throw std::runtime_error(std::string("Task ") + name + " depends on a task not added yet");
+		tasks_[dependency].dependents.push_back(id);
+	}
+
+	return id;
+}
+
+void job_system::run()
+{
+	if (tasks_.empty())
+		return;
+
+	remaining_.store(tasks_.size());
+	++run_count_;
+	task_count_ += tasks_.size();
+
+	// Round-robin, so that every thread starts with its share. The threads
+	// may already be queueing the dependents of the first ones meanwhile, so
+	// what's ready is told by dependency_count rather than waiting
+	std::size_t next = 0;
+	for (task_id id = 0; id < tasks_.size(); ++id)
+	{
+		if (tasks_[id].dependency_count != 0)
+			continue;
+
+		auto & q = *queues_[next++ % queues_.size()];
+		std::lock_guard lock(q.mutex);
+		q.tasks.push_back(id);
+	}
+
+	{
+		std::lock_guard lock(mutex_);
+		++generation_;
+	}
+	wake_.notify_all();
+
+	while (remaining_.load() > 0)
+	{
+		std::uint64_t seen;
+		{
+			std::lock_guard lock(mutex_);
+			seen = generation_;
+		}
+
+		if (!run_one(0))
+		{
+			std::unique_lock lock(mutex_);
+			wake_.wait(lock, [&]{ return remaining_.load() == 0 || generation_ != seen; });
+		}
+	}
+
+	tasks_.clear();
+
+	if (auto error = std::exchange(error_, nullptr))
+		std::rethrow_exception(error);
+}
+
+void job_system::parallel_for(char const * name, std::size_t count, std::size_t grain, std::function<void(std::size_t, std::size_t)> const & body)
+{
+	grain = std::max<std::size_t>(1, grain);
+	if (count <= grain)
+	{
+		if (count > 0)
+			body(0, count);
+		return;
+	}
+
+	for (std::size_t begin = 0; begin < count; begin += grain)
+	{
+		std::size_t const end = std::min(count, begin + grain);
+		add(name, [&body, begin, end]{ body(begin, end); });
+	}
+	run();
+}
+
+void job_system::report(std::ostream & out) const
+{
+	if (run_count_ == 0)
+		return;
+
+	out << "Jobs: " << float(task_count_) / run_count_ << " tasks per run on " << thread_count() << " threads, "
+		<< 100.f * stolen_count_.load() / task_count_ << "% stolen" << std::endl;
+}
+
+void job_system::push(std::size_t thread, task_id id)
+{
+	{
+		auto & own = *queues_[thread];
+		std::lock_guard lock(own.mutex);
+		own.tasks.push_back(id);
+	}
+
+	{
+		std::lock_guard lock(mutex_);
+		++generation_;
+	}
+	wake_.notify_all();
+}
+
+bool job_system::run_one(std::size_t thread)
+{
+	std::optional<task_id> id;
+
+	{
+		auto & own = *queues_[thread];
+		std::lock_guard lock(own.mutex);
+		if (!own.tasks.empty())
+		{
+			id = own.tasks.back();
+			own.tasks.pop_back();
+		}
+	}
+
+	for (std::size_t i = 1; !id && i < queues_.size(); ++i)
+	{
+		auto & victim = *queues_[(thread + i) % queues_.size()];
+		std::lock_guard lock(victim.mutex);
+		if (!victim.tasks.empty())
+		{
+			id = victim.tasks.front();
+			victim.tasks.pop_front();
+			stolen_count_.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	if (!id)
+		return false;
+
+	auto & t = tasks_[*id];
+	try
+	{
+		t.job();
+	}
+	catch (...)
+	{
+		std::lock_guard lock(mutex_);
+		if (!error_)
+			error_ = std::current_exception();
+	}
+
+	for (auto dependent : t.dependents)
+		if (tasks_[dependent].waiting.fetch_sub(1) == 1)
+			push(thread, dependent);
+
+	if (remaining_.fetch_sub(1) == 1)
+	{
+		std::lock_guard lock(mutex_);
+		wake_.notify_all();
+	}
+	return true;
+}
+
+void job_system::work(std::size_t thread)
+{
+	for (std::uint64_t seen = 0;;)
+	{
+		{
+			std::unique_lock lock(mutex_);
+			wake_.wait(lock, [&]{ return stop_ || generation_ != seen; });
+			if (stop_)
+				return;
+			seen = generation_;
+		}
+
+		while (run_one(thread))
+			;
+	}
+}
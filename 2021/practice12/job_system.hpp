@@ -0,0 +1,94 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <vector>
+
+// Runs graphs of tasks on threads that live as long as the system. Every
+// thread has its own deque of ready tasks: it takes them from the back and,
+// once it runs out, steals from the front of the others'. A task is ready
+// when all the tasks it depends on are done, and the thread finishing the
+// last of them queues it on its own deque, where the data it needs is likely
+// still in cache
+class job_system
+{
+public:
+	using task_id = std::uint32_t;
+
+	explicit job_system(std::size_t thread_count = std::max(1u, std::thread::hardware_concurrency()));
+	~job_system();
+
+	job_system(job_system const &) = delete;
+	job_system & operator = (job_system const &) = delete;
+
+	std::size_t thread_count() const { return queues_.size(); }
+
+	// The name must outlive the run. The dependencies must have been added
+	// before, in the same graph
+	task_id add(char const * name, std::function<void()> job, std::span<task_id const> dependencies = {});
+
+	// Runs the tasks added since the last run and returns once they are all
+	// done, the calling thread taking part. Rethrows the first exception a
+	// task threw; the other tasks still run. Not to be called from a task
+	void run();
+
+	// body(begin, end) over [0, count) in ranges of at most grain items, as
+	// one graph of its own; small counts run right on the calling thread
+	void parallel_for(char const * name, std::size_t count, std::size_t grain, std::function<void(std::size_t, std::size_t)> const & body);
+
+	// Tasks per run and how many of them were stolen
+	void report(std::ostream & out) const;
+
+private:
+	struct task
+	{
+		char const * name;
+		std::function<void()> job;
+		std::vector<task_id> dependents;
+		std::uint32_t dependency_count = 0;
+		// Dependencies not done yet
+		std::atomic<std::uint32_t> waiting{0};
+	};
+
+	struct queue
+	{
+		std::mutex mutex;
+		std::deque<task_id> tasks;
+	};
+
+	// Of the current graph; a deque so that adding doesn't move the atomics
+	std::deque<task> tasks_;
+
+	// One per thread, the calling one is 0
+	std::vector<std::unique_ptr<queue>> queues_;
+	std::vector<std::thread> threads_;
+
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	// Bumped whenever tasks are queued, for the idle threads to look again
+	std::uint64_t generation_ = 0;
+	bool stop_ = false;
+	std::atomic<std::size_t> remaining_{0};
+	std::exception_ptr error_;
+
+	std::size_t run_count_ = 0;
+	std::size_t task_count_ = 0;
+	std::atomic<std::size_t> stolen_count_{0};
+
+	void push(std::size_t thread, task_id id);
+	// Runs one task, from the thread's queue or stolen; false if there are none
+	bool run_one(std::size_t thread);
+	void work(std::size_t thread);
+};
@@ -14,6 +14,12 @@
 #include <chrono>
 #include <vector>
 #include <map>
+#include <cstdlib>
+#include <cstddef>
+#include <string>
+#include <optional>
+#include <algorithm>
+#include <cmath>
 
 #define GLM_FORCE_SWIZZLE
 #define GLM_ENABLE_EXPERIMENTAL
@@ -24,6 +30,12 @@
 #include <glm/ext/scalar_constants.hpp>
 #include <glm/gtx/string_cast.hpp>
 
+#include "brick_volume.hpp"
+#include "marching_cubes.hpp"
+#include "job_system.hpp"
+#include "gpu_isosurface.hpp"
+#include "sparse_octree.hpp"
+
 std::string to_string(std::string_view str)
 {
 	return std::string(str.begin(), str.end());
@@ -62,13 +74,235 @@ R"(#version 330 core
 uniform vec3 camera_position;
 uniform vec3 light_dir;
 
+// See brick_volume
+uniform usampler3D indirection;
+uniform sampler3D atlas;
+uniform sampler3D coarse;
+uniform int bricks;
+uniform float atlas_size;
+uniform float step_size;
+uniform float density;
+// For the level of detail: the size of a unit at distance 1 in pixels, and
+// of a voxel of the coarse volume's first level
+uniform float pixels_per_unit;
+uniform float coarse_voxel;
+
+in vec3 position;
+
+layout (location = 0) out vec4 out_color;
+
+const int BRICK_SIZE = 32;
+const int APRON = 1;
+const int SLOT_SIZE = BRICK_SIZE + 2 * APRON;
+const uint RESIDENT = 1u;
+const uint EMPTY = 2u;
+
+vec2 intersect_cube(vec3 origin, vec3 direction)
+{
+	vec3 t0 = (vec3(-1.0) - origin) / direction;
+	vec3 t1 = (vec3( 1.0) - origin) / direction;
+	vec3 tmin = min(t0, t1);
+	vec3 tmax = max(t0, t1);
+	return vec2(max(tmin.x, max(tmin.y, tmin.z)), min(tmax.x, min(tmax.y, tmax.z)));
+}
+
+void main()
+{
+	vec3 direction = normalize(position - camera_position);
+	vec2 interval = intersect_cube(camera_position, direction);
+	float t = max(interval.x, 0.0) + 0.5 * step_size;
+	float step = step_size;
+
+	vec3 color = vec3(0.0);
+	float opacity = 0.0;
+	for (int i = 0; i < 4096 && t < interval.y && opacity < 0.99; ++i)
+	{
+		vec3 p = (camera_position + t * direction) * 0.5 + 0.5;
+		vec3 brick_position = p * float(bricks);
+		ivec3 brick = clamp(ivec3(brick_position), ivec3(0), ivec3(bricks - 1));
+		uvec4 entry = texelFetch(indirection, brick, 0);
+
+		if (entry.a == EMPTY)
+		{
+			// Straight to where the ray leaves the brick
+			vec3 brick_min = vec3(brick) / float(bricks) * 2.0 - 1.0;
+			vec2 brick_interval = intersect_cube((camera_position - brick_min) * float(bricks) - 1.0, direction);
+			t += max(ceil((brick_interval.y / float(bricks) - t) / step), 1.0) * step;
+			continue;
+		}
+
+		vec4 value;
+		if (entry.a == RESIDENT)
+		{
+			step = step_size;
+			vec3 voxel = vec3(entry.xyz * uint(SLOT_SIZE) + uint(APRON)) + (brick_position - vec3(brick)) * float(BRICK_SIZE);
+			value = texture(atlas, voxel / atlas_size);
+		}
+		else
+		{
+			// The level whose voxels are a pixel across here, stepped through at a voxel per step
+			float lod = max(0.0, log2(t / pixels_per_unit / coarse_voxel));
+			step = coarse_voxel * exp2(lod) * 0.5;
+			value = textureLod(coarse, p, lod);
+		}
+
+		float alpha = 1.0 - exp(-value.a * density * step);
+		color += (1.0 - opacity) * alpha * value.rgb;
+		opacity += (1.0 - opacity) * alpha;
+
+		t += step;
+	}
+
+	if (opacity <= 0.0)
+		discard;
+
+	out_color = vec4(color / opacity, opacity);
+}
+)";
+
+const char sparse_fragment_shader_source[] =
+R"(#version 330 core
+
+uniform vec3 camera_position;
+
+// See sparse_octree
+uniform usamplerBuffer nodes;
+uniform sampler3D atlas;
+uniform int depth;
+uniform int slots;
+uniform float step_size;
+uniform float density;
+// The size of a unit at distance 1 in pixels
+uniform float pixels_per_unit;
+
+in vec3 position;
+
+layout (location = 0) out vec4 out_color;
+
+const int BRICK_SIZE = 8;
+const int APRON = 1;
+const int SLOT_SIZE = BRICK_SIZE + 2 * APRON;
+const uint EMPTY = 0x80000000u;
+const uint LEAF = 0x40000000u;
+const uint INDEX = 0x3FFFFFFFu;
+
+vec2 intersect_box(vec3 origin, vec3 direction, vec3 box_min, vec3 box_max)
+{
+	vec3 t0 = (box_min - origin) / direction;
+	vec3 t1 = (box_max - origin) / direction;
+	vec3 tmin = min(t0, t1);
+	vec3 tmax = max(t0, t1);
+	return vec2(max(tmin.x, max(tmin.y, tmin.z)), min(tmax.x, min(tmax.y, tmax.z)));
+}
+
+vec4 unpack_average(uint value)
+{
+	return vec4(uvec4(value, value >> 8, value >> 16, value >> 24) & 0xFFu) / 255.0;
+}
+
+void main()
+{
+	vec3 direction = normalize(position - camera_position);
+	vec2 interval = intersect_box(camera_position, direction, vec3(-1.0), vec3(1.0));
+	float t = max(interval.x, 0.0) + 0.5 * step_size;
+
+	vec3 color = vec3(0.0);
+	float opacity = 0.0;
+	for (int i = 0; i < 4096 && t < interval.y && opacity < 0.99; ++i)
+	{
+		vec3 p = clamp((camera_position + t * direction) * 0.5 + 0.5, vec3(0.0), vec3(1.0));
+
+		// Down to the node around p, or to one under a pixel across
+		vec3 node_min = vec3(0.0);
+		float node_size = 1.0;
+		uvec2 node = texelFetch(nodes, 0).rg;
+		float pixel = t / pixels_per_unit;
+		for (int level = 0; level < depth && (node.x & (EMPTY | LEAF)) == 0u && 2.0 * node_size > pixel; ++level)
+		{
+			node_size *= 0.5;
+			ivec3 child = ivec3(greaterThanEqual(p, node_min + vec3(node_size)));
+			node_min += vec3(child) * node_size;
+			node = texelFetch(nodes, int((node.x & INDEX) + uint(child.x + 2 * child.y + 4 * child.z))).rg;
+		}
+
+		// Where the ray leaves the node, in whole steps
+		float exit = intersect_box(camera_position, direction, node_min * 2.0 - 1.0, (node_min + node_size) * 2.0 - 1.0).y;
+		float node_step = max(ceil((exit - t) / step_size), 1.0) * step_size;
+
+		if ((node.x & EMPTY) != 0u)
+		{
+			t += node_step;
+			continue;
+		}
+
+		vec4 value;
+		float step;
+		if ((node.x & LEAF) != 0u)
+		{
+			uint slot = node.x & INDEX;
+			ivec3 slot_position = ivec3(int(slot) % slots, (int(slot) / slots) % slots, int(slot) / (slots * slots));
+			vec3 voxel = vec3(slot_position * SLOT_SIZE + APRON) + (p - node_min) / node_size * float(BRICK_SIZE);
+			value = texture(atlas, voxel / float(slots * SLOT_SIZE));
+			step = step_size;
+		}
+		else
+		{
+			// The rest of the node at its average
+			value = unpack_average(node.y);
+			step = node_step;
+		}
+
+		float alpha = 1.0 - exp(-value.a * density * step);
+		color += (1.0 - opacity) * alpha * value.rgb;
+		opacity += (1.0 - opacity) * alpha;
+
+		t += step;
+	}
+
+	if (opacity <= 0.0)
+		discard;
+
+	out_color = vec4(color / opacity, opacity);
+}
+)";
+
+const char mesh_vertex_shader_source[] =
+R"(#version 330 core
+
+uniform mat4 view;
+uniform mat4 projection;
+
+layout (location = 0) in vec3 in_position;
+layout (location = 1) in vec3 in_normal;
+
+out vec3 position;
+out vec3 normal;
+
+void main()
+{
+	position = in_position;
+	normal = in_normal;
+	gl_Position = projection * view * vec4(in_position, 1.0);
+}
+)";
+
+const char mesh_fragment_shader_source[] =
+R"(#version 330 core
+
+uniform vec3 light_dir;
+// The colours of the volume, from its coarse level
+uniform sampler3D coarse;
+
 in vec3 position;
+in vec3 normal;
 
 layout (location = 0) out vec4 out_color;
 
 void main()
 {
-	out_color = vec4(position * 0.5 + vec3(0.5), 1.0);
+	vec3 albedo = texture(coarse, position * 0.5 + 0.5).rgb;
+	float diffuse = max(0.0, dot(normalize(normal), light_dir));
+	out_color = vec4(albedo * (0.3 + 0.7 * diffuse), 1.0);
 }
 )";
 
@@ -196,6 +430,15 @@ int main() try
 	GLuint projection_location = glGetUniformLocation(program, "projection");
 	GLuint camera_position_location = glGetUniformLocation(program, "camera_position");
 	GLuint light_dir_location = glGetUniformLocation(program, "light_dir");
+	GLuint indirection_location = glGetUniformLocation(program, "indirection");
+	GLuint atlas_location = glGetUniformLocation(program, "atlas");
+	GLuint coarse_location = glGetUniformLocation(program, "coarse");
+	GLuint bricks_location = glGetUniformLocation(program, "bricks");
+	GLuint atlas_size_location = glGetUniformLocation(program, "atlas_size");
+	GLuint step_size_location = glGetUniformLocation(program, "step_size");
+	GLuint density_location = glGetUniformLocation(program, "density");
+	GLuint pixels_per_unit_location = glGetUniformLocation(program, "pixels_per_unit");
+	GLuint coarse_voxel_location = glGetUniformLocation(program, "coarse_voxel");
 
 	GLuint vao, vbo, ebo;
 	glGenVertexArrays(1, &vao);
@@ -212,6 +455,113 @@ int main() try
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
 
+	// VOLUME picks the dataset (house256 by default), VOLUME_CACHE_MB the video
+	// memory for its full resolution bricks (32 by default)
+	std::string volume_name = "house256";
+	if (char const * env = std::getenv("VOLUME"))
+		volume_name = env;
+	std::size_t cache_megabytes = 32;
+	if (char const * env = std::getenv("VOLUME_CACHE_MB"))
+		cache_megabytes = std::stoul(env);
+
+	brick_volume volume(std::string(PRACTICE_SOURCE_DIRECTORY) + "/" + volume_name, cache_megabytes << 20);
+
+	// ISOSURFACE=128 draws the surface where the density crosses 128,
+	// extracted by marching cubes, instead of ray marching the volume. With
+	// ISOSURFACE_GPU=1 it's extracted on the GPU instead, every time [ and ]
+	// move the level
+	GLuint mesh_program = 0, mesh_vao = 0, mesh_vbo = 0, mesh_ebo = 0;
+	GLuint mesh_view_location = 0, mesh_projection_location = 0, mesh_light_dir_location = 0, mesh_coarse_location = 0;
+	std::size_t mesh_index_count = 0;
+	std::optional<gpu_isosurface> gpu_iso;
+	float iso_level = 0.f;
+	if (char const * env = std::getenv("ISOSURFACE"))
+	{
+		int const iso = std::stoi(env);
+		if (iso < 1 || iso > 255)
+			throw std::runtime_error("ISOSURFACE must be a density from 1 to 255");
+		iso_level = iso;
+
+		auto mesh_fragment_shader = create_shader(GL_FRAGMENT_SHADER, mesh_fragment_shader_source);
+		if (std::getenv("ISOSURFACE_GPU"))
+		{
+			gpu_iso.emplace(volume.voxels(), volume.size(), mesh_fragment_shader);
+			mesh_program = gpu_iso->program();
+		}
+		else
+		{
+			job_system jobs;
+			auto const start = std::chrono::high_resolution_clock::now();
+			obj_data const mesh = extract_isosurface(volume.voxels(), volume.size(), iso, jobs);
+			float const extraction_ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			std::cout << "Isosurface " << iso << " of " << volume_name << ": " << mesh.indices.size() / 3 << " triangles, "
+				<< mesh.vertices.size() << " vertices in " << extraction_ms << " ms on " << jobs.thread_count() << " threads" << std::endl;
+
+			auto mesh_vertex_shader = create_shader(GL_VERTEX_SHADER, mesh_vertex_shader_source);
+			mesh_program = create_program(mesh_vertex_shader, mesh_fragment_shader);
+			glDeleteShader(mesh_vertex_shader);
+
+			glGenVertexArrays(1, &mesh_vao);
+			glBindVertexArray(mesh_vao);
+
+			glGenBuffers(1, &mesh_vbo);
+			glBindBuffer(GL_ARRAY_BUFFER, mesh_vbo);
+			glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(mesh.vertices[0]), mesh.vertices.data(), GL_STATIC_DRAW);
+
+			glGenBuffers(1, &mesh_ebo);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh_ebo);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(mesh.indices[0]), mesh.indices.data(), GL_STATIC_DRAW);
+
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(obj_data::vertex), (void*)offsetof(obj_data::vertex, position));
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(obj_data::vertex), (void*)offsetof(obj_data::vertex, normal));
+
+			mesh_index_count = mesh.indices.size();
+		}
+		glDeleteShader(mesh_fragment_shader);
+
+		mesh_view_location = glGetUniformLocation(mesh_program, "view");
+		mesh_projection_location = glGetUniformLocation(mesh_program, "projection");
+		mesh_light_dir_location = glGetUniformLocation(mesh_program, "light_dir");
+		mesh_coarse_location = glGetUniformLocation(mesh_program, "coarse");
+	}
+
+	std::size_t shown_triangles = 0;
+	int shown_level = 0;
+
+	// SPARSE_VOLUME=1 ray marches the volume from a sparse octree, all of it
+	// resident, instead of streaming bricks
+	std::optional<sparse_octree> sparse;
+	GLuint sparse_program = 0;
+	GLuint sparse_view_location = 0, sparse_projection_location = 0, sparse_camera_position_location = 0;
+	GLuint sparse_step_size_location = 0, sparse_density_location = 0, sparse_pixels_per_unit_location = 0;
+	if (std::getenv("SPARSE_VOLUME"))
+	{
+		auto const start = std::chrono::high_resolution_clock::now();
+		sparse.emplace(volume.voxels(), volume.size());
+		float const build_ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		sparse->report(std::cout);
+		std::cout << "Built in " << build_ms << " ms" << std::endl;
+
+		auto sparse_fragment_shader = create_shader(GL_FRAGMENT_SHADER, sparse_fragment_shader_source);
+		sparse_program = create_program(vertex_shader, sparse_fragment_shader);
+		glDeleteShader(sparse_fragment_shader);
+
+		sparse_view_location = glGetUniformLocation(sparse_program, "view");
+		sparse_projection_location = glGetUniformLocation(sparse_program, "projection");
+		sparse_camera_position_location = glGetUniformLocation(sparse_program, "camera_position");
+		sparse_step_size_location = glGetUniformLocation(sparse_program, "step_size");
+		sparse_density_location = glGetUniformLocation(sparse_program, "density");
+		sparse_pixels_per_unit_location = glGetUniformLocation(sparse_program, "pixels_per_unit");
+
+		glUseProgram(sparse_program);
+		glUniform1i(glGetUniformLocation(sparse_program, "nodes"), 0);
+		glUniform1i(glGetUniformLocation(sparse_program, "atlas"), 1);
+		glUniform1i(glGetUniformLocation(sparse_program, "depth"), sparse->depth());
+		glUniform1i(glGetUniformLocation(sparse_program, "slots"), sparse->slots_per_axis());
+	}
+
 	auto last_frame_start = std::chrono::high_resolution_clock::now();
 
 	float time = 0.f;
@@ -285,13 +635,29 @@ int main() try
 		if (button_down[SDLK_UP])
 			camera_position.y += 3.f * dt;
 
+		if (gpu_iso)
+		{
+			if (button_down[SDLK_LEFTBRACKET])
+				iso_level -= 40.f * dt;
+			if (button_down[SDLK_RIGHTBRACKET])
+				iso_level += 40.f * dt;
+			iso_level = std::clamp(iso_level, 1.f, 255.f);
+
+			int const level = std::lround(iso_level);
+			gpu_iso->update(level);
+
+			if (level != shown_level || gpu_iso->triangle_count() != shown_triangles)
+			{
+				shown_level = level;
+				shown_triangles = gpu_iso->triangle_count();
+				std::string const title = "Graphics course practice 12: isosurface " + std::to_string(level) + ", "
+					+ std::to_string(shown_triangles) + " triangles";
+				SDL_SetWindowTitle(window, title.c_str());
+			}
+		}
+
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		glEnable(GL_DEPTH_TEST);
-		glEnable(GL_CULL_FACE);
-		glCullFace(GL_FRONT);
-
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 		float near = 0.1f;
 		float far = 100.f;
@@ -304,11 +670,92 @@ int main() try
 
 		glm::vec3 light_dir = glm::normalize(glm::vec3(std::cos(time), 1.f, std::sin(time)));
 
+		if (mesh_program)
+		{
+			glDisable(GL_BLEND);
+			glEnable(GL_CULL_FACE);
+			glCullFace(GL_BACK);
+
+			glUseProgram(mesh_program);
+			glUniformMatrix4fv(mesh_view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
+			glUniformMatrix4fv(mesh_projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
+			glUniform3fv(mesh_light_dir_location, 1, reinterpret_cast<float *>(&light_dir));
+			// Past the units gpu_isosurface uses
+			glUniform1i(mesh_coarse_location, 4);
+
+			glActiveTexture(GL_TEXTURE4);
+			glBindTexture(GL_TEXTURE_3D, volume.coarse_texture());
+			glActiveTexture(GL_TEXTURE0);
+
+			if (gpu_iso)
+				gpu_iso->draw();
+			else
+			{
+				glBindVertexArray(mesh_vao);
+				glDrawElements(GL_TRIANGLES, mesh_index_count, GL_UNSIGNED_INT, nullptr);
+			}
+
+			SDL_GL_SwapWindow(window);
+			continue;
+		}
+
+		glEnable(GL_CULL_FACE);
+		glCullFace(GL_FRONT);
+
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+		// The projection's vertical field of view is 90 degrees
+		float const pixels_per_unit = height / 2.f;
+
+		if (sparse)
+		{
+			glUseProgram(sparse_program);
+			glUniformMatrix4fv(sparse_view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
+			glUniformMatrix4fv(sparse_projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
+			glUniform3fv(sparse_camera_position_location, 1, reinterpret_cast<float *>(&camera_position));
+			glUniform1f(sparse_step_size_location, 2.f / volume.size());
+			glUniform1f(sparse_density_location, 4.f);
+			glUniform1f(sparse_pixels_per_unit_location, pixels_per_unit);
+
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_BUFFER, sparse->node_texture());
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_3D, sparse->atlas_texture());
+			glActiveTexture(GL_TEXTURE0);
+
+			glBindVertexArray(vao);
+			glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, nullptr);
+
+			SDL_GL_SwapWindow(window);
+			continue;
+		}
+
+		volume.update(projection * view, camera_position, pixels_per_unit, 16);
+
 		glUseProgram(program);
 		glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
 		glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
 		glUniform3fv(camera_position_location, 1, reinterpret_cast<float *>(&camera_position));
 		glUniform3fv(light_dir_location, 1, reinterpret_cast<float *>(&light_dir));
+		glUniform1i(indirection_location, 0);
+		glUniform1i(atlas_location, 1);
+		glUniform1i(coarse_location, 2);
+		glUniform1i(bricks_location, volume.bricks_per_axis());
+		glUniform1f(atlas_size_location, volume.slots_per_axis() * brick_volume::slot_size);
+		// A voxel per step
+		glUniform1f(step_size_location, 2.f / volume.size());
+		glUniform1f(density_location, 4.f);
+		glUniform1f(pixels_per_unit_location, pixels_per_unit);
+		glUniform1f(coarse_voxel_location, 2.f * brick_volume::coarse_factor / volume.size());
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_3D, volume.indirection_texture());
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_3D, volume.atlas_texture());
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_3D, volume.coarse_texture());
+		glActiveTexture(GL_TEXTURE0);
 
 		glBindVertexArray(vao);
 		glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, nullptr);
@@ -0,0 +1,318 @@
+#include "marching_cubes.hpp"
+
+#include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+
+	// Corner i of a cell is at (x, y, z) + offset[i], edge i joins the corners
+	// edge_corners[i]
+	constexpr int corner_offsets[8][3]
+	{
+		{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0},
+		{0, 0, 1}, {1, 0, 1}, {1, 1, 1}, {0, 1, 1},
+	};
+
+	constexpr int edge_corners[12][2]
+	{
+		{0, 1}, {1, 2}, {3, 2}, {0, 3},
+		{4, 5}, {5, 6}, {7, 6}, {4, 7},
+		{0, 4}, {1, 5}, {2, 6}, {3, 7},
+	};
+
+	// The corners of each face, in any cyclic order; see build_table
+	constexpr int face_corners[6][4]
+	{
+		{0, 3, 2, 1}, {4, 5, 6, 7},
+		{0, 1, 5, 4}, {3, 7, 6, 2},
+		{0, 4, 7, 3}, {1, 2, 6, 5},
+	};
+
+	int edge_between(int a, int b)
+	{
+		for (int e = 0; e < 12; ++e)
+			if ((edge_corners[e][0] == a && edge_corners[e][1] == b) || (edge_corners[e][0] == b && edge_corners[e][1] == a))
+				return e;
+		return -1;
+	}
+
+	// The triangles of every case, from the bits of the corners inside (dense
+	// enough). On each face the crossings are joined into segments with the
+	// inside on their left, seen from outside the cell, which chain into
+	// closed loops around the cell, each fanned into triangles. A face with
+	// its two inside corners on a diagonal cuts off each of them, and since
+	// that depends on the face's corners only, neighbouring cells agree and
+	// the surface has no cracks
+	std::array<marching_cubes_case, 256> build_table()
+	{
+		// Faces turned counterclockwise seen from outside, by the cross
+		// product of the first two sides against the direction to the face
+		int faces[6][4];
+		for (int f = 0; f < 6; ++f)
+		{
+			glm::vec3 p[4];
+			glm::vec3 center{0.f};
+			for (int i = 0; i < 4; ++i)
+			{
+				auto const & o = corner_offsets[face_corners[f][i]];
+				p[i] = glm::vec3(o[0], o[1], o[2]);
+				center += p[i] * 0.25f;
+			}
+
+			bool const reverse = glm::dot(glm::cross(p[1] - p[0], p[2] - p[1]), center - glm::vec3(0.5f)) < 0.f;
+			for (int i = 0; i < 4; ++i)
+				faces[f][i] = face_corners[f][reverse ? 3 - i : i];
+		}
+
+		std::array<marching_cubes_case, 256> table;
+		for (int c = 0; c < 256; ++c)
+		{
+			auto const inside = [c](int corner){ return (c >> corner) & 1; };
+
+			// The edge each crossing's segment leads to
+			int next[12];
+			std::fill(std::begin(next), std::end(next), -1);
+			for (auto const & face : faces)
+			{
+				// Leaving the inside at side k, the segment goes back to where
+				// the walk last entered it
+				for (int k = 0; k < 4; ++k)
+				{
+					if (!inside(face[k]) || inside(face[(k + 1) % 4]))
+						continue;
+
+					int j = (k + 3) % 4;
+					while (inside(face[j]))
+						j = (j + 3) % 4;
+
+					next[edge_between(face[k], face[(k + 1) % 4])] = edge_between(face[j], face[(j + 1) % 4]);
+				}
+			}
+
+			marching_cubes_case & result = table[c];
+			bool used[12] = {};
+			for (int start = 0; start < 12; ++start)
+			{
+				if (next[start] < 0 || used[start])
+					continue;
+
+				int loop[12];
+				int length = 0;
+				for (int e = start; !used[e]; e = next[e])
+				{
+					used[e] = true;
+					loop[length++] = e;
+				}
+
+				// The loop runs clockwise seen from the outside of the surface
+				for (int i = 1; i + 1 < length; ++i)
+				{
+					result.edges[3 * result.triangle_count + 0] = loop[0];
+					result.edges[3 * result.triangle_count + 1] = loop[i + 1];
+					result.edges[3 * result.triangle_count + 2] = loop[i];
+					++result.triangle_count;
+				}
+			}
+		}
+		return table;
+	}
+
+	constexpr std::uint32_t no_vertex = std::numeric_limits<std::uint32_t>::max();
+
+	struct block_mesh
+	{
+		std::vector<obj_data::vertex> vertices;
+		std::vector<std::uint32_t> indices;
+	};
+
+	class block_extractor
+	{
+	public:
+		block_extractor(std::uint8_t const * voxels, int size, std::uint8_t iso)
+			: voxels_(voxels)
+			, size_(size)
+			, iso_(iso)
+			, level_(iso - 0.5f)
+		{}
+
+		// The cells from begin to end (exclusive) along each axis
+		void extract(std::array<int, 3> const & begin, std::array<int, 3> const & end, block_mesh & result)
+		{
+			if (!crosses(begin, end))
+				return;
+
+			begin_ = begin;
+			stride_ = end[0] - begin[0] + 1;
+			std::size_t const plane = std::size_t(stride_) * (end[1] - begin[1] + 1);
+			for (int p = 0; p < 2; ++p)
+			{
+				x_edges_[p].assign(plane, no_vertex);
+				y_edges_[p].assign(plane, no_vertex);
+			}
+			z_edges_.assign(plane, no_vertex);
+
+			auto const & cases = marching_cubes_cases();
+			for (int z = begin[2]; z < end[2]; ++z)
+			{
+				// The lattice plane above gets the slots of the one below the layer
+				if (z > begin[2])
+				{
+					std::fill(x_edges_[(z + 1) & 1].begin(), x_edges_[(z + 1) & 1].end(), no_vertex);
+					std::fill(y_edges_[(z + 1) & 1].begin(), y_edges_[(z + 1) & 1].end(), no_vertex);
+					std::fill(z_edges_.begin(), z_edges_.end(), no_vertex);
+				}
+
+				for (int y = begin[1]; y < end[1]; ++y)
+					for (int x = begin[0]; x < end[0]; ++x)
+					{
+						int index = 0;
+						for (int i = 0; i < 8; ++i)
+							if (density(x + corner_offsets[i][0], y + corner_offsets[i][1], z + corner_offsets[i][2]) >= iso_)
+								index |= 1 << i;
+
+						marching_cubes_case const & cell = cases[index];
+						for (int t = 0; t < 3 * cell.triangle_count; ++t)
+							result.indices.push_back(edge_vertex(x, y, z, cell.edges[t], result));
+					}
+			}
+		}
+
+	private:
+		std::uint8_t const * voxels_;
+		int size_;
+		std::uint8_t iso_;
+		float level_;
+
+		std::array<int, 3> begin_;
+		int stride_ = 0;
+		// Per lattice point of the block's current two planes (by z parity),
+		// the vertex on the edge from it along x and y, and along z to the
+		// next plane for the current layer
+		std::vector<std::uint32_t> x_edges_[2];
+		std::vector<std::uint32_t> y_edges_[2];
+		std::vector<std::uint32_t> z_edges_;
+
+		std::uint8_t density(int x, int y, int z) const
+		{
+			return voxels_[((std::size_t(z) * size_ + y) * size_ + x) * 4 + 3];
+		}
+
+		// Whether any voxel of the cells is on the other side from the first
+		bool crosses(std::array<int, 3> const & begin, std::array<int, 3> const & end) const
+		{
+			bool const first = density(begin[0], begin[1], begin[2]) >= iso_;
+			for (int z = begin[2]; z <= end[2]; ++z)
+				for (int y = begin[1]; y <= end[1]; ++y)
+					for (int x = begin[0]; x <= end[0]; ++x)
+						if ((density(x, y, z) >= iso_) != first)
+							return true;
+			return false;
+		}
+
+		// Central differences, one-sided at the volume's faces
+		glm::vec3 gradient(int x, int y, int z) const
+		{
+			auto const difference = [&](int axis)
+			{
+				int p[3] = {x, y, z};
+				int n[3] = {x, y, z};
+				p[axis] = std::min(p[axis] + 1, size_ - 1);
+				n[axis] = std::max(n[axis] - 1, 0);
+				return (float(density(p[0], p[1], p[2])) - float(density(n[0], n[1], n[2]))) / float(p[axis] - n[axis]);
+			};
+			return {difference(0), difference(1), difference(2)};
+		}
+
+		std::uint32_t edge_vertex(int x, int y, int z, int edge, block_mesh & result)
+		{
+			auto const & a = corner_offsets[edge_corners[edge][0]];
+			auto const & b = corner_offsets[edge_corners[edge][1]];
+			int const axis = a[0] != b[0] ? 0 : a[1] != b[1] ? 1 : 2;
+			int const lx = x + a[0], ly = y + a[1], lz = z + a[2];
+
+			std::size_t const slot = std::size_t(ly - begin_[1]) * stride_ + (lx - begin_[0]);
+			std::uint32_t & cached = axis == 0 ? x_edges_[lz & 1][slot] : axis == 1 ? y_edges_[lz & 1][slot] : z_edges_[slot];
+			if (cached != no_vertex)
+				return cached;
+
+			int const ux = lx + (axis == 0), uy = ly + (axis == 1), uz = lz + (axis == 2);
+			float const da = density(lx, ly, lz);
+			float const db = density(ux, uy, uz);
+			float const t = (level_ - da) / (db - da);
+
+			glm::vec3 position(lx, ly, lz);
+			position[axis] += t;
+			// Voxel centers, as the ray marcher samples them
+			position = (position + 0.5f) * (2.f / size_) - 1.f;
+
+			glm::vec3 normal = -glm::mix(gradient(lx, ly, lz), gradient(ux, uy, uz), t);
+			float const length = glm::length(normal);
+			if (length > 0.f)
+				normal /= length;
+
+			cached = result.vertices.size();
+			result.vertices.push_back({{position.x, position.y, position.z}, {normal.x, normal.y, normal.z}, {0.f, 0.f}});
+			return cached;
+		}
+	};
+
+}
+
+std::array<marching_cubes_case, 256> const & marching_cubes_cases()
+{
+	static std::array<marching_cubes_case, 256> const result = build_table();
+	return result;
+}
+
+obj_data extract_isosurface(std::uint8_t const * voxels, int size, std::uint8_t iso, job_system & jobs, int block_size)
+{
+	marching_cubes_cases();
+
+	int const cells = size - 1;
+	int const blocks = (cells + block_size - 1) / block_size;
+	std::size_t const block_count = std::size_t(blocks) * blocks * blocks;
+
+	std::vector<block_mesh> meshes(block_count);
+	jobs.parallel_for("Marching cubes", block_count, 1, [&](std::size_t begin, std::size_t end)
+	{
+		block_extractor extractor(voxels, size, iso);
+		for (std::size_t b = begin; b < end; ++b)
+		{
+			int const bx = b % blocks, by = (b / blocks) % blocks, bz = b / (std::size_t(blocks) * blocks);
+			std::array<int, 3> const first{bx * block_size, by * block_size, bz * block_size};
+			std::array<int, 3> const last{
+				std::min(first[0] + block_size, cells),
+				std::min(first[1] + block_size, cells),
+				std::min(first[2] + block_size, cells),
+			};
+			extractor.extract(first, last, meshes[b]);
+		}
+	});
+
+	std::vector<std::size_t> vertex_base(block_count + 1, 0), index_base(block_count + 1, 0);
+	for (std::size_t b = 0; b < block_count; ++b)
+	{
+		vertex_base[b + 1] = vertex_base[b] + meshes[b].vertices.size();
+		index_base[b + 1] = index_base[b] + meshes[b].indices.size();
+	}
+
+	obj_data result;
+	result.vertices.resize(vertex_base.back());
+	result.indices.resize(index_base.back());
+	jobs.parallel_for("Marching cubes merge", block_count, 16, [&](std::size_t begin, std::size_t end)
+	{
+		for (std::size_t b = begin; b < end; ++b)
+		{
+			std::copy(meshes[b].vertices.begin(), meshes[b].vertices.end(), result.vertices.begin() + vertex_base[b]);
+			std::uint32_t const base = vertex_base[b];
+			std::transform(meshes[b].indices.begin(), meshes[b].indices.end(), result.indices.begin() + index_base[b],
+				[base](std::uint32_t index){ return base + index; });
+		}
+	});
+
+	return result;
+}
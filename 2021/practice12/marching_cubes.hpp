@@ -0,0 +1,48 @@
+#pragma once
+
+#include "job_system.hpp"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// An indexed triangle mesh laid out as the obj_data of the 2022 practices'
+// obj_parser, so it can go wherever those meshes go; texcoord is zero
+struct obj_data
+{
+	struct vertex
+	{
+		std::array<float, 3> position;
+		std::array<float, 3> normal;
+		std::array<float, 2> texcoord;
+	};
+
+	std::vector<vertex> vertices;
+	std::vector<std::uint32_t> indices;
+};
+
+// The triangles of a cell, by the bit mask of its corners inside (dense
+// enough). Corner i is at (x, y, z) plus (0, 0, 0), (1, 0, 0), (1, 1, 0),
+// (0, 1, 0) and the same four at z + 1; the edges are the ones along x, y,
+// x and y around the lower face, the same around the upper one, then the
+// four along z from corners 0 to 3. The triangles face away from the inside
+// in the order given, for the GPU extraction as much as this one
+struct marching_cubes_case
+{
+	int triangle_count = 0;
+	// Three edges per triangle
+	std::array<std::uint8_t, 15> edges;
+};
+
+std::array<marching_cubes_case, 256> const & marching_cubes_cases();
+
+// The isosurface where the density (alpha) of a cubic RGBA8 volume of size^3
+// voxels crosses iso, in the [-1, 1]^3 cube the volume is drawn in, facing
+// away from the denser side with normals from the density gradient. The
+// cells are split into blocks of block_size^3, extracted in parallel on the
+// job system and concatenated in order, so the result doesn't depend on the
+// thread count. Within a block each edge crossing becomes one vertex shared
+// by the up to four cells around it, cached by edge a layer of cells at a
+// time; the crossings on the faces between blocks are duplicated, one
+// vertex per block. Blocks whose voxels all lie on one side are skipped
+obj_data extract_isosurface(std::uint8_t const * voxels, int size, std::uint8_t iso, job_system & jobs, int block_size = 32);
@@ -0,0 +1,54 @@
+#include "marching_cubes.hpp"
+#include "job_system.hpp"
+#include "mapped_file.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+
+// Usage: marching_cubes_benchmark [iso]
+// Extracts the isosurface (at density 128 by default) of house and bunny at
+// 64^3, 128^3 and 256^3 on one thread and on all of them, best of a few runs
+int main(int argc, char ** argv) try
+{
+	int const iso = argc > 1 ? std::stoi(argv[1]) : 128;
+
+	job_system single(1);
+	job_system all;
+
+	for (char const * name : {"house", "bunny"})
+	{
+		for (int size : {64, 128, 256})
+		{
+			mapped_file file(std::string(PRACTICE_SOURCE_DIRECTORY) + "/" + name + std::to_string(size));
+			if (file.size() != std::size_t(size) * size * size * 4)
+				throw std::runtime_error(std::string(name) + std::to_string(size) + " has the wrong size");
+
+			auto const voxels = reinterpret_cast<std::uint8_t const *>(file.data());
+
+			for (job_system * jobs : {&single, &all})
+			{
+				double best = 1e30;
+				obj_data mesh;
+				for (int run = 0; run < 5; ++run)
+				{
+					auto const start = std::chrono::steady_clock::now();
+					mesh = extract_isosurface(voxels, size, iso, *jobs);
+					best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+				}
+
+				std::cout << name << size << " on " << jobs->thread_count() << " threads: " << best << " ms, "
+					<< mesh.indices.size() / 3 << " triangles, " << mesh.vertices.size() << " vertices" << std::endl;
+			}
+		}
+	}
+}
+catch (std::exception const & e)
+{
+	std::cerr << e.what() << std::endl;
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,205 @@
+#include "sparse_octree.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+
+	// Sums over a node's region, for its average
+	struct node_sums
+	{
+		bool occupied = false;
+		double density = 0.0;
+		// Colour times density
+		std::array<double, 3> color{};
+	};
+
+	std::uint32_t pack_average(node_sums const & sums, double voxel_count)
+	{
+		auto const channel = [](double value){ return std::uint32_t(std::clamp(std::lround(value), 0l, 255l)); };
+
+		std::uint32_t result = channel(sums.density / voxel_count) << 24;
+		if (sums.density > 0.0)
+			for (int c = 0; c < 3; ++c)
+				result |= channel(sums.color[c] / sums.density) << (8 * c);
+		return result;
+	}
+
+}
+
+sparse_octree::sparse_octree(std::uint8_t const * voxels, int size)
+	: size_(size)
+{
+	if (size < brick_size || (size & (size - 1)) != 0)
+		throw std::runtime_error("A sparse octree needs a power of two volume size of at least " + std::to_string(brick_size));
+
+	int const bricks = size / brick_size;
+	while ((1 << depth_) < bricks)
+		++depth_;
+
+	auto const voxel = [&](int x, int y, int z)
+	{
+		return voxels + ((std::size_t(z) * size + y) * size + x) * voxel_bytes;
+	};
+
+	// The bricks' sums, then every level up to the root from the one below,
+	// levels[d] holding the 2^d nodes per axis at depth d
+	std::vector<std::vector<node_sums>> levels(depth_ + 1);
+	levels[depth_].resize(std::size_t(bricks) * bricks * bricks);
+	for (int bz = 0; bz < bricks; ++bz)
+		for (int by = 0; by < bricks; ++by)
+			for (int bx = 0; bx < bricks; ++bx)
+			{
+				node_sums & sums = levels[depth_][(std::size_t(bz) * bricks + by) * bricks + bx];
+
+				int const x0 = bx * brick_size, y0 = by * brick_size, z0 = bz * brick_size;
+				for (int z = std::max(z0 - apron, 0); z < std::min(z0 + brick_size + apron, size); ++z)
+					for (int y = std::max(y0 - apron, 0); y < std::min(y0 + brick_size + apron, size); ++y)
+						for (int x = std::max(x0 - apron, 0); x < std::min(x0 + brick_size + apron, size); ++x)
+						{
+							auto const v = voxel(x, y, z);
+							if (v[3] == 0)
+								continue;
+
+							sums.occupied = true;
+							if (x < x0 || y < y0 || z < z0 || x >= x0 + brick_size || y >= y0 + brick_size || z >= z0 + brick_size)
+								continue;
+
+							sums.density += v[3];
+							for (int c = 0; c < 3; ++c)
+								sums.color[c] += double(v[c]) * v[3];
+						}
+			}
+
+	for (int d = depth_ - 1; d >= 0; --d)
+	{
+		int const n = 1 << d;
+		levels[d].resize(std::size_t(n) * n * n);
+		for (int z = 0; z < n; ++z)
+			for (int y = 0; y < n; ++y)
+				for (int x = 0; x < n; ++x)
+				{
+					node_sums & sums = levels[d][(std::size_t(z) * n + y) * n + x];
+					for (int i = 0; i < 8; ++i)
+					{
+						node_sums const & child = levels[d + 1][(std::size_t(2 * z + (i >> 2)) * 2 * n + 2 * y + ((i >> 1) & 1)) * 2 * n + 2 * x + (i & 1)];
+						sums.occupied = sums.occupied || child.occupied;
+						sums.density += child.density;
+						for (int c = 0; c < 3; ++c)
+							sums.color[c] += child.color[c];
+					}
+				}
+	}
+
+	std::size_t const occupied_bricks = std::count_if(levels[depth_].begin(), levels[depth_].end(), [](node_sums const & s){ return s.occupied; });
+
+	GLint max_3d_size;
+	glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &max_3d_size);
+	slots_ = std::max(1, int(std::ceil(std::cbrt(double(occupied_bricks)))));
+	if (std::size_t(slots_) * slots_ * slots_ < occupied_bricks)
+		++slots_;
+	if (slots_ * slot_size > max_3d_size)
+		throw std::runtime_error("The " + std::to_string(occupied_bricks) + " bricks don't fit in a 3D texture");
+
+	int const atlas_size = slots_ * slot_size;
+	glGenTextures(1, &atlas_texture_);
+	glBindTexture(GL_TEXTURE_3D, atlas_texture_);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA8, atlas_size, atlas_size, atlas_size, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	std::vector<std::uint8_t> staging(std::size_t(slot_size) * slot_size * slot_size * voxel_bytes);
+	auto const upload_brick = [&](int bx, int by, int bz) -> std::uint32_t
+	{
+		std::uint32_t const slot = brick_count_++;
+
+		auto out = staging.data();
+		for (int z = 0; z < slot_size; ++z)
+		{
+			int const vz = std::clamp(bz * brick_size + z - apron, 0, size - 1);
+			for (int y = 0; y < slot_size; ++y)
+			{
+				int const vy = std::clamp(by * brick_size + y - apron, 0, size - 1);
+				for (int x = 0; x < slot_size; ++x, out += voxel_bytes)
+					std::copy_n(voxel(std::clamp(bx * brick_size + x - apron, 0, size - 1), vy, vz), voxel_bytes, out);
+			}
+		}
+
+		int const sx = slot % slots_;
+		int const sy = (slot / slots_) % slots_;
+		int const sz = slot / (slots_ * slots_);
+		glTexSubImage3D(GL_TEXTURE_3D, 0, sx * slot_size, sy * slot_size, sz * slot_size, slot_size, slot_size, slot_size,
+			GL_RGBA, GL_UNSIGNED_BYTE, staging.data());
+		return slot;
+	};
+
+	// Top down, so that each node's eight children are next to each other
+	std::vector<std::uint32_t> nodes(2, 0);
+	auto const build = [&](auto const & self, std::size_t index, int d, int x, int y, int z) -> void
+	{
+		int const n = 1 << d;
+		node_sums const & sums = levels[d][(std::size_t(z) * n + y) * n + x];
+		if (!sums.occupied)
+		{
+			nodes[2 * index] = empty_node;
+			nodes[2 * index + 1] = 0;
+			return;
+		}
+
+		double const node_voxels = std::pow(double(size >> d), 3.0);
+		nodes[2 * index + 1] = pack_average(sums, node_voxels);
+
+		if (d == depth_)
+		{
+			nodes[2 * index] = leaf_node | upload_brick(x, y, z);
+			return;
+		}
+
+		std::size_t const first = nodes.size() / 2;
+		if (first + 8 > index_mask)
+			throw std::runtime_error("Too many octree nodes");
+		nodes[2 * index] = first;
+		nodes.resize(nodes.size() + 16, 0);
+		for (int i = 0; i < 8; ++i)
+			self(self, first + i, d + 1, 2 * x + (i & 1), 2 * y + ((i >> 1) & 1), 2 * z + (i >> 2));
+	};
+	build(build, 0, 0, 0, 0, 0);
+	node_count_ = nodes.size() / 2;
+
+	glGenBuffers(1, &node_buffer_);
+	glBindBuffer(GL_TEXTURE_BUFFER, node_buffer_);
+	glBufferData(GL_TEXTURE_BUFFER, nodes.size() * sizeof(nodes[0]), nodes.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	glGenTextures(1, &node_texture_);
+	glBindTexture(GL_TEXTURE_BUFFER, node_texture_);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, node_buffer_);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+sparse_octree::~sparse_octree()
+{
+	glDeleteTextures(1, &node_texture_);
+	glDeleteBuffers(1, &node_buffer_);
+	glDeleteTextures(1, &atlas_texture_);
+}
+
+void sparse_octree::report(std::ostream & out) const
+{
+	std::size_t const dense_bytes = std::size_t(size_) * size_ * size_ * voxel_bytes;
+	std::size_t const atlas_bytes = std::size_t(slots_ * slot_size) * (slots_ * slot_size) * (slots_ * slot_size) * voxel_bytes;
+	std::size_t const node_bytes = node_count_ * 2 * sizeof(std::uint32_t);
+	std::size_t const bricks = std::size_t(1) << (3 * depth_);
+
+	out << "Sparse octree: " << node_count_ << " nodes, " << brick_count_ << " of " << bricks << " bricks, "
+		<< ((atlas_bytes + node_bytes) >> 20) << " MB against " << (dense_bytes >> 20) << " MB dense" << std::endl;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+// A cubic RGBA8 volume (density in alpha) as an octree down to bricks of
+// brick_size^3 voxels, all of it resident. A node whose region is zero,
+// along with the voxel around it that filtering reaches, is empty and has no
+// children; the others have eight, in x, y, z bit order, or at the bottom a
+// brick, whose slot in an atlas texture holds only the non-empty ones. So
+// the ray marcher can skip empty space a whole node at a time, and the
+// memory goes only to where there is something. Every node also keeps the
+// average colour and density of its region, for the ray marcher to stop at
+// when the node is under a pixel across.
+//
+// The nodes are two words each in an RG32UI buffer texture: the flags and
+// the index of the first child or of the brick's slot, then the average as
+// packed RGBA8, colour weighted by density
+class sparse_octree
+{
+public:
+	static constexpr int voxel_bytes = 4;
+	static constexpr int brick_size = 8;
+	// As in brick_volume
+	static constexpr int apron = 1;
+	static constexpr int slot_size = brick_size + 2 * apron;
+
+	static constexpr std::uint32_t empty_node = 1u << 31;
+	static constexpr std::uint32_t leaf_node = 1u << 30;
+	static constexpr std::uint32_t index_mask = leaf_node - 1;
+
+	// size must be a power of two of at least brick_size
+	sparse_octree(std::uint8_t const * voxels, int size);
+	~sparse_octree();
+
+	sparse_octree(sparse_octree const &) = delete;
+	sparse_octree & operator = (sparse_octree const &) = delete;
+
+	int size() const { return size_; }
+	// Levels below the root, the last being the bricks'
+	int depth() const { return depth_; }
+	int slots_per_axis() const { return slots_; }
+
+	GLuint node_texture() const { return node_texture_; }
+	GLuint atlas_texture() const { return atlas_texture_; }
+
+	std::size_t node_count() const { return node_count_; }
+	std::size_t brick_count() const { return brick_count_; }
+
+	// Node and brick counts and the video memory against the dense volume's
+	void report(std::ostream & out) const;
+
+private:
+	int size_ = 0;
+	int depth_ = 0;
+	int slots_ = 0;
+	std::size_t node_count_ = 0;
+	std::size_t brick_count_ = 0;
+
+	GLuint node_buffer_ = 0;
+	GLuint node_texture_ = 0;
+	GLuint atlas_texture_ = 0;
+};
@@ -1,6 +1,8 @@
 #include "frustum.hpp"
+#include "intersect.hpp"
 
 #include <glm/geometric.hpp>
+#include <glm/common.hpp>
 
 frustum::frustum(glm::mat4 const & view_projection)
 {
@@ -44,4 +46,56 @@ frustum::frustum(glm::mat4 const & view_projection)
 		e(2, 6),
 		e(3, 7),
 	};
+
+	vertex_min = vertex_max = vertices[0];
+	for (auto const & v : vertices)
+	{
+		vertex_min = glm::min(vertex_min, v);
+		vertex_max = glm::max(vertex_max, v);
+	}
+
+	// A zero axis never separates anything
+	axis_count = 0;
+	auto add_axis = [&](glm::vec3 const & n)
+	{
+		if (n == glm::vec3(0.f))
+			return;
+		auto [min, max] = project(*this, n);
+		axes[axis_count++] = {n, min, max};
+	};
+	for (auto const & n : face_normals)
+		add_axis(n);
+	for (auto const & e1 : aabb::edge_directions)
+		for (auto const & e2 : edge_directions)
+			add_axis(glm::cross(e1, e2));
+}
+
+bool frustum::intersects(glm::vec3 const & min, glm::vec3 const & max) const
+{
+	for (int i = 0; i < 3; ++i)
+	{
+		if (vertex_max[i] < min[i] || max[i] < vertex_min[i])
+			return false;
+	}
+
+	for (std::size_t i = 0; i < axis_count; ++i)
+	{
+		auto const & a = axes[i];
+		glm::vec3 const low(a.n.x < 0.f ? max.x : min.x, a.n.y < 0.f ? max.y : min.y, a.n.z < 0.f ? max.z : min.z);
+		glm::vec3 const high(a.n.x < 0.f ? min.x : max.x, a.n.y < 0.f ? min.y : max.y, a.n.z < 0.f ? min.z : max.z);
+		if (a.max < glm::dot(low, a.n) || glm::dot(high, a.n) < a.min)
+			return false;
+	}
+
+	return true;
+}
+
+bool intersect(aabb const & box, frustum const & f)
+{
+	return f.intersects(box.vertices[0], box.vertices[7]);
+}
+
+bool intersect(frustum const & f, aabb const & box)
+{
+	return f.intersects(box.vertices[0], box.vertices[7]);
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "aabb.hpp"
+
 #include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
 
@@ -11,5 +13,28 @@ struct frustum
 	std::array<glm::vec3, 5> face_normals;
 	std::array<glm::vec3, 6> edge_directions;
 
+	// The frustum's half of the SAT against boxes, see intersects(): the
+	// bounds of its vertices, which are its projections on the
+	// box's face normals, and its projections on its own face normals and on
+	// the crosses of its edges with the box's, less the zero ones
+	struct separating_axis
+	{
+		glm::vec3 n;
+		float min, max;
+	};
+	glm::vec3 vertex_min, vertex_max;
+	std::array<separating_axis, 23> axes;
+	std::size_t axis_count;
+
 	frustum(glm::mat4 const & view_projection);
+
+	// Exactly the SAT intersect() of intersect.hpp with an aabb(min, max),
+	// without making one: on the box's 3 face normals it and the frustum are
+	// compared by their bounds, on the other axes only the box is projected,
+	// through its corners nearest and farthest along the axis
+	bool intersects(glm::vec3 const & min, glm::vec3 const & max) const;
 };
+
+// The same as f.intersects() for the box's corners
+bool intersect(aabb const & box, frustum const & f);
+bool intersect(frustum const & f, aabb const & box);
@@ -0,0 +1,70 @@
+#include "lod_streamer.hpp"
+#include "mesh_optimizer.hpp"
+
+#include <fstream>
+#include <span>
+#include <stdexcept>
+
+mesh_level load_mesh_level(std::filesystem::path const & path, float scale, int level)
+{
+	std::ifstream in(path);
+	if (!in)
+		throw std::runtime_error("Failed to open " + path.string());
+
+	mesh_level result{level};
+	std::tie(result.vertices, result.indices) = load_obj(in, scale);
+	fill_normals(result.vertices, result.indices);
+
+	std::vector<glm::vec3> positions;
+	positions.reserve(result.vertices.size());
+	for (auto const & v : result.vertices)
+		positions.push_back(v.position);
+	result.meshlets = build_meshlets(positions, result.indices, 0, result.indices.size());
+
+	// The order within each meshlet is free, so it's the post-transform
+	// cache's; load_obj's optimize would be undone by the meshlets
+	for (auto const & m : result.meshlets)
+		optimize_vertex_cache(std::span(result.indices).subspan(m.first, m.count));
+	remap_vertices(result.vertices, optimize_vertex_fetch(result.indices, result.vertices.size()));
+
+	std::tie(result.min, result.max) = bbox(result.vertices);
+	return result;
+}
+
+lod_streamer::lod_streamer(std::vector<std::filesystem::path> paths, float scale)
+	: remaining_(paths.size())
+	, thread_([this, paths = std::move(paths), scale]
+	{
+		for (int level = paths.size() - 1; level >= 0 && !stopping_; --level) try
+		{
+			auto result = load_mesh_level(paths[level], scale, level);
+			std::lock_guard lock(mutex_);
+			finished_.push_back(std::move(result));
+		}
+		catch (std::exception const & e)
+		{
+			std::lock_guard lock(mutex_);
+			error_ = e.what();
+			return;
+		}
+	})
+{}
+
+lod_streamer::~lod_streamer()
+{
+	stopping_ = true;
+	thread_.join();
+}
+
+std::vector<mesh_level> lod_streamer::take()
+{
+	std::vector<mesh_level> result;
+	{
+		std::lock_guard lock(mutex_);
+		if (!error_.empty())
+			throw std::runtime_error(error_);
+		result.swap(finished_);
+	}
+	remaining_ -= result.size();
+	return result;
+}
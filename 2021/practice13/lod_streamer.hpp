@@ -0,0 +1,59 @@
+#pragma once
+
+#include "mesh_utils.hpp"
+#include "meshlets.hpp"
+
+#include <glm/vec3.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One level of detail ready for the GPU: with normals, its triangles cut into
+// meshlets, each ordered for the post-transform cache, and its vertices for
+// fetching
+struct mesh_level
+{
+	// Index into the paths given to lod_streamer, 0 being the finest
+	int level;
+	std::vector<vertex> vertices;
+	std::vector<std::uint32_t> indices;
+	std::vector<meshlet> meshlets;
+	glm::vec3 min, max;
+};
+
+mesh_level load_mesh_level(std::filesystem::path const & path, float scale, int level = 0);
+
+// Loads the levels of a mesh on a thread of its own, coarsest (the last
+// path) first, so that something can be drawn right away while the finer
+// ones stream in
+class lod_streamer
+{
+public:
+	lod_streamer(std::vector<std::filesystem::path> paths, float scale);
+	~lod_streamer();
+
+	lod_streamer(lod_streamer const &) = delete;
+	lod_streamer & operator = (lod_streamer const &) = delete;
+
+	// The levels finished since the last call, in the order they were
+	// loaded; rethrows on the calling thread if loading one failed
+	std::vector<mesh_level> take();
+
+	// Whether every level has been taken
+	bool done() const { return remaining_ == 0; }
+
+private:
+	std::size_t remaining_;
+
+	std::mutex mutex_;
+	std::vector<mesh_level> finished_;
+	std::string error_;
+	std::atomic<bool> stopping_{false};
+
+	std::thread thread_;
+};
@@ -15,6 +15,10 @@
 #include <chrono>
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <optional>
 
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
@@ -27,6 +31,9 @@
 #include "frustum.hpp"
 #include "mesh_utils.hpp"
 #include "intersect.hpp"
+#include "meshlets.hpp"
+#include "mesh_optimizer.hpp"
+#include "lod_streamer.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -48,17 +55,18 @@ R"(#version 330 core
 
 uniform mat4 view;
 uniform mat4 projection;
-uniform vec3 offset;
 
 layout (location = 0) in vec3 in_position;
 layout (location = 1) in vec3 in_normal;
+// Per instance, or a constant for the draws of a single one
+layout (location = 2) in vec3 in_offset;
 
 out vec3 normal;
 
 void main()
 {
 	normal = in_normal;
-	gl_Position = projection * view * vec4(in_position + offset, 1.0);
+	gl_Position = projection * view * vec4(in_position + in_offset, 1.0);
 }
 )";
 
@@ -96,6 +104,30 @@ GLuint create_shader(GLenum type, const char * source)
 	return result;
 }
 
+// Appends to a buffer of the given size, growing its storage (and keeping
+// its contents and name) when it runs out
+void append_buffer(GLuint buffer, std::size_t & size, std::size_t & capacity, void const * data, std::size_t data_size)
+{
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	if (size + data_size > capacity)
+	{
+		std::size_t const new_capacity = std::max(2 * capacity, size + data_size);
+
+		GLuint copy;
+		glGenBuffers(1, &copy);
+		glBindBuffer(GL_COPY_READ_BUFFER, copy);
+		glBufferData(GL_COPY_READ_BUFFER, size, nullptr, GL_STATIC_COPY);
+		glCopyBufferSubData(GL_COPY_WRITE_BUFFER, GL_COPY_READ_BUFFER, 0, 0, size);
+
+		glBufferData(GL_COPY_WRITE_BUFFER, new_capacity, nullptr, GL_STATIC_DRAW);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+		glDeleteBuffers(1, &copy);
+		capacity = new_capacity;
+	}
+	glBufferSubData(GL_COPY_WRITE_BUFFER, size, data_size, data);
+	size += data_size;
+}
+
 template<typename ... Shaders>
 GLuint create_program(Shaders ... shaders) {
 	GLuint result = glCreateProgram();
@@ -161,34 +193,72 @@ int main() try
 
 	GLuint view_location = glGetUniformLocation(program, "view");
 	GLuint projection_location = glGetUniformLocation(program, "projection");
-	GLuint offset_location = glGetUniformLocation(program, "offset");
 	GLuint light_dir_location = glGetUniformLocation(program, "light_dir");
 
-	std::vector<vertex> vertices;
-	std::vector<std::uint32_t> indices;
-	{
-		std::ifstream in(PRACTICE_SOURCE_DIRECTORY "/bunny0.obj");
-		std::tie(vertices, indices) = load_obj(in, 4.f);
-	}
-	fill_normals(vertices, indices);
+	// All the levels of the bunny share one vertex and one index buffer,
+	// each in ranges of its own, and are appended as they are loaded,
+	// coarsest first
+	std::vector<std::filesystem::path> level_paths;
+	for (int level = 0; level < 6; ++level)
+		level_paths.push_back(PRACTICE_SOURCE_DIRECTORY "/bunny" + std::to_string(level) + ".obj");
+	lod_streamer levels_loading(level_paths, 4.f);
 
-	GLuint vao, vbo, ebo;
+	struct level_range
+	{
+		// In the index buffer; the indices already point at the level's
+		// vertices
+		std::uint32_t first;
+		std::uint32_t count;
+		glm::vec3 min, max;
+		// With first offset by the level's start
+		std::vector<meshlet> meshlets;
+	};
+	std::vector<std::optional<level_range>> levels(level_paths.size());
+	// The finest loaded level; all the coarser ones are loaded too
+	int finest_level = levels.size();
+
+	std::vector<GLsizei> draw_counts;
+	std::vector<void const *> draw_offsets;
+
+	GLuint vao, vbo, ebo, instance_vbo;
 	glGenVertexArrays(1, &vao);
 	glBindVertexArray(vao);
 
+	std::size_t vbo_size = 0, vbo_capacity = 0, ebo_size = 0, ebo_capacity = 0;
 	glGenBuffers(1, &vbo);
 	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertices[0]), vertices.data(), GL_STATIC_DRAW);
 
 	glGenBuffers(1, &ebo);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(indices[0]), indices.data(), GL_STATIC_DRAW);
 
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), nullptr);
 	glEnableVertexAttribArray(1);
 	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)(12));
 
+	glGenBuffers(1, &instance_vbo);
+	glVertexAttribDivisor(2, 1);
+
+	// BUNNY_GRID=n draws n by n bunnies instead of one. Those outside the
+	// frustum are skipped, the others get a level by their distance, the
+	// finer one for every doubling of lod_distance closer, or the finest one
+	// loaded yet. The finest level is drawn a bunny at a time through its
+	// culled meshlets, the coarser ones instanced, all the bunnies of a level
+	// in one draw
+	int grid_size = 1;
+	if (char const * env = std::getenv("BUNNY_GRID"))
+		grid_size = std::max(1, std::atoi(env));
+	float const grid_spacing = 1.5f;
+	float const lod_distance = 4.f;
+
+	std::vector<glm::vec3> instances;
+	for (int x = 0; x < grid_size; ++x)
+		for (int z = 0; z < grid_size; ++z)
+			instances.push_back(glm::vec3(x - (grid_size - 1) / 2.f, 0.f, -z) * grid_spacing);
+
+	std::vector<std::vector<glm::vec3>> level_instances(levels.size());
+	std::vector<glm::vec3> instance_data;
+
 	auto last_frame_start = std::chrono::high_resolution_clock::now();
 
 	float time = 0.f;
@@ -230,6 +300,23 @@ int main() try
 		if (!running)
 			break;
 
+		if (!levels_loading.done()) for (auto & level : levels_loading.take())
+		{
+			std::uint32_t const first_vertex = vbo_size / sizeof(vertex);
+			std::uint32_t const first_index = ebo_size / sizeof(std::uint32_t);
+			for (auto & index : level.indices)
+				index += first_vertex;
+			for (auto & m : level.meshlets)
+				m.first += first_index;
+
+			append_buffer(vbo, vbo_size, vbo_capacity, level.vertices.data(), level.vertices.size() * sizeof(vertex));
+			append_buffer(ebo, ebo_size, ebo_capacity, level.indices.data(), level.indices.size() * sizeof(std::uint32_t));
+
+			levels[level.level] = level_range{first_index, std::uint32_t(level.indices.size()), level.min, level.max, std::move(level.meshlets)};
+			finest_level = std::min(finest_level, level.level);
+			std::cout << "Loaded LOD " << level.level << ": " << level.indices.size() / 3 << " triangles" << std::endl;
+		}
+
 		auto now = std::chrono::high_resolution_clock::now();
 		float dt = std::chrono::duration_cast<std::chrono::duration<float>>(now - last_frame_start).count();
 		last_frame_start = now;
@@ -283,8 +370,56 @@ int main() try
 		glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
 		glUniform3fv(light_dir_location, 1, reinterpret_cast<float *>(&light_dir));
 
+		frustum const view_frustum(projection * view);
+
+		for (auto & list : level_instances)
+			list.clear();
+		if (finest_level < int(levels.size())) for (auto const & offset : instances)
+		{
+			// The coarsest level is always there, and its bounds are near
+			// enough to all the others'
+			auto const & bounds = *levels[levels.size() - 1];
+			if (!view_frustum.intersects(bounds.min + offset, bounds.max + offset))
+				continue;
+
+			float const distance = glm::distance(camera_position, offset + (bounds.min + bounds.max) / 2.f);
+			int const level = std::clamp(int(std::log2(std::max(distance / lod_distance, 1.f))), finest_level, int(levels.size()) - 1);
+			level_instances[level].push_back(offset);
+		}
+
 		glBindVertexArray(vao);
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, nullptr);
+
+		// The finest level's bunnies one by one, with the offset as a constant
+		// attribute, and their meshlets culled in model space
+		glDisableVertexAttribArray(2);
+		if (finest_level == 0) for (auto const & offset : level_instances[0])
+		{
+			glVertexAttrib3fv(2, reinterpret_cast<float const *>(&offset));
+			cull_meshlets(levels[0]->meshlets, frustum(projection * glm::translate(view, offset)), camera_position - offset, draw_counts, draw_offsets);
+			glMultiDrawElements(GL_TRIANGLES, draw_counts.data(), GL_UNSIGNED_INT, draw_offsets.data(), draw_counts.size());
+		}
+
+		// All the others, with the offsets of every level one after another in
+		// the instance buffer
+		instance_data.clear();
+		for (std::size_t level = (finest_level == 0) ? 1 : 0; level < levels.size(); ++level)
+			instance_data.insert(instance_data.end(), level_instances[level].begin(), level_instances[level].end());
+
+		glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+		glBufferData(GL_ARRAY_BUFFER, instance_data.size() * sizeof(glm::vec3), instance_data.data(), GL_STREAM_DRAW);
+		glEnableVertexAttribArray(2);
+
+		std::size_t instance_start = 0;
+		for (std::size_t level = (finest_level == 0) ? 1 : 0; level < levels.size(); ++level)
+		{
+			auto const count = level_instances[level].size();
+			if (count == 0)
+				continue;
+
+			glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), reinterpret_cast<void const *>(instance_start * sizeof(glm::vec3)));
+			glDrawElementsInstanced(GL_TRIANGLES, levels[level]->count, GL_UNSIGNED_INT, reinterpret_cast<void const *>(std::uintptr_t(levels[level]->first) * sizeof(std::uint32_t)), count);
+			instance_start += count;
+		}
 
 		SDL_GL_SwapWindow(window);
 	}
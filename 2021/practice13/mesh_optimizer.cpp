@@ -0,0 +1,304 @@
+#include "mesh_optimizer.hpp"
+
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <numeric>
+
+namespace
+{
+
+	// The indices renumbered to [0, vertex_count) in the order of the
+	// original numbers, so that a range of a large mesh only needs as much
+	// state as it has vertices
+	std::vector<std::uint32_t> local_indices(std::span<std::uint32_t const> indices, std::uint32_t & vertex_count)
+	{
+		std::vector<std::uint32_t> vertices(indices.begin(), indices.end());
+		std::sort(vertices.begin(), vertices.end());
+		vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+		vertex_count = vertices.size();
+
+		std::vector<std::uint32_t> result(indices.size());
+		for (std::size_t i = 0; i < indices.size(); ++i)
+			result[i] = std::lower_bound(vertices.begin(), vertices.end(), indices[i]) - vertices.begin();
+		return result;
+	}
+
+	// A FIFO cache as in the hardware: a vertex is in it if fewer than
+	// cache_size vertices came in since it did
+	struct cache_simulation
+	{
+		int cache_size;
+		std::vector<int> entered_at;
+		int time = 0;
+		int misses = 0;
+
+		cache_simulation(std::uint32_t vertex_count, int cache_size)
+			: cache_size(cache_size)
+			, entered_at(vertex_count, -cache_size - 1)
+		{}
+
+		// The misses of one triangle
+		int triangle(std::uint32_t const * vertices)
+		{
+			int result = 0;
+			for (int k = 0; k < 3; ++k)
+			{
+				if (time - entered_at[vertices[k]] > cache_size)
+				{
+					entered_at[vertices[k]] = time++;
+					++result;
+				}
+			}
+			misses += result;
+			return result;
+		}
+
+		// Empties the cache and the count
+		void reset()
+		{
+			time += cache_size + 1;
+			misses = 0;
+		}
+	};
+
+}
+
+float average_cache_miss_ratio(std::span<std::uint32_t const> indices, int cache_size)
+{
+	if (indices.size() < 3)
+		return 0.f;
+
+	std::uint32_t vertex_count;
+	auto local = local_indices(indices, vertex_count);
+
+	cache_simulation cache(vertex_count, cache_size);
+	for (std::size_t i = 0; i + 3 <= local.size(); i += 3)
+		cache.triangle(local.data() + i);
+	return float(cache.misses) / float(local.size() / 3);
+}
+
+void optimize_vertex_cache(std::span<std::uint32_t> indices, int cache_size)
+{
+	std::size_t const triangle_count = indices.size() / 3;
+	if (triangle_count == 0)
+		return;
+
+	std::uint32_t vertex_count;
+	auto local = local_indices(indices, vertex_count);
+
+	// The triangles around each vertex, and how many of them aren't out yet
+	std::vector<std::uint32_t> offsets(vertex_count + 1, 0);
+	for (std::size_t i = 0; i < 3 * triangle_count; ++i)
+		++offsets[local[i] + 1];
+	std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+	std::vector<std::uint32_t> adjacency(offsets.back());
+	{
+		std::vector<std::uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (std::size_t i = 0; i < 3 * triangle_count; ++i)
+			adjacency[fill[local[i]]++] = i / 3;
+	}
+
+	std::vector<int> live(vertex_count);
+	for (std::uint32_t v = 0; v < vertex_count; ++v)
+		live[v] = offsets[v + 1] - offsets[v];
+
+	std::vector<int> cached_at(vertex_count, 0);
+	std::vector<bool> emitted(triangle_count, false);
+	std::vector<std::uint32_t> dead_ends;
+	std::vector<std::uint32_t> candidates;
+	std::vector<std::uint32_t> order;
+	order.reserve(triangle_count);
+
+	int time = cache_size + 1;
+	std::uint32_t next_vertex = 0;
+	std::int64_t fan = 0;
+
+	while (fan >= 0)
+	{
+		candidates.clear();
+		for (auto j = offsets[fan]; j < offsets[fan + 1]; ++j)
+		{
+			std::uint32_t const t = adjacency[j];
+			if (emitted[t])
+				continue;
+
+			emitted[t] = true;
+			order.push_back(t);
+
+			for (int k = 0; k < 3; ++k)
+			{
+				std::uint32_t const v = local[3 * t + k];
+				dead_ends.push_back(v);
+				candidates.push_back(v);
+				--live[v];
+				if (time - cached_at[v] > cache_size)
+					cached_at[v] = time++;
+			}
+		}
+
+		// The candidate that stays in the cache while its remaining
+		// triangles go out and has been in it the longest
+		fan = -1;
+		int best = -1;
+		for (auto v : candidates)
+		{
+			if (live[v] == 0)
+				continue;
+
+			int priority = 0;
+			if (time - cached_at[v] + 2 * live[v] <= cache_size)
+				priority = time - cached_at[v];
+			if (priority > best)
+			{
+				best = priority;
+				fan = v;
+			}
+		}
+
+		// Dead end: the latest vertex with triangles left, or the next one
+		// in order
+		while (fan < 0 && !dead_ends.empty())
+		{
+			std::uint32_t const v = dead_ends.back();
+			dead_ends.pop_back();
+			if (live[v] > 0)
+				fan = v;
+		}
+
+		for (; fan < 0 && next_vertex < vertex_count; ++next_vertex)
+			if (live[next_vertex] > 0)
+				fan = next_vertex;
+	}
+
+	std::vector<std::uint32_t> result(3 * triangle_count);
+	for (std::size_t i = 0; i < triangle_count; ++i)
+		std::copy_n(indices.begin() + 3 * order[i], 3, result.begin() + 3 * i);
+	std::copy(result.begin(), result.end(), indices.begin());
+}
+
+void optimize_overdraw(std::span<std::uint32_t> indices, std::vector<glm::vec3> const & positions, int cache_size, float threshold)
+{
+	std::size_t const triangle_count = indices.size() / 3;
+	if (triangle_count == 0)
+		return;
+
+	std::uint32_t vertex_count;
+	auto local = local_indices(indices, vertex_count);
+
+	// Hard boundaries where the cache order starts afresh, all three
+	// vertices missing
+	std::vector<std::size_t> hard{0};
+	{
+		cache_simulation cache(vertex_count, cache_size);
+		for (std::size_t t = 0; t < triangle_count; ++t)
+			if (cache.triangle(local.data() + 3 * t) == 3 && t > 0)
+				hard.push_back(t);
+		hard.push_back(triangle_count);
+	}
+
+	// Soft boundaries within them, wherever the ACMR so far is within the
+	// threshold of the whole hard cluster's
+	std::vector<std::size_t> boundaries;
+	cache_simulation cache(vertex_count, cache_size);
+	for (std::size_t c = 0; c + 1 < hard.size(); ++c)
+	{
+		std::size_t const begin = hard[c];
+		std::size_t const end = hard[c + 1];
+
+		cache.reset();
+		for (std::size_t t = begin; t < end; ++t)
+			cache.triangle(local.data() + 3 * t);
+		float const limit = threshold * float(cache.misses) / float(end - begin);
+
+		cache.reset();
+		std::size_t start = begin;
+		boundaries.push_back(begin);
+		for (std::size_t t = begin; t < end; ++t)
+		{
+			cache.triangle(local.data() + 3 * t);
+
+			if (t + 1 < end && float(cache.misses) / float(t + 1 - start) <= limit)
+			{
+				boundaries.push_back(t + 1);
+				start = t + 1;
+				cache.reset();
+			}
+		}
+	}
+	boundaries.push_back(triangle_count);
+
+	// Area weighted centroids and normals of the clusters and of the whole
+	struct cluster
+	{
+		std::size_t begin, end;
+		float key;
+	};
+
+	auto triangle_position = [&](std::size_t t, int k) -> glm::vec3 const &
+	{
+		return positions[indices[3 * t + k]];
+	};
+
+	glm::vec3 mesh_centroid(0.f);
+	float mesh_area = 0.f;
+	for (std::size_t t = 0; t < triangle_count; ++t)
+	{
+		float const area = glm::length(glm::cross(triangle_position(t, 1) - triangle_position(t, 0), triangle_position(t, 2) - triangle_position(t, 0)));
+		mesh_centroid += area * (triangle_position(t, 0) + triangle_position(t, 1) + triangle_position(t, 2));
+		mesh_area += 3.f * area;
+	}
+	if (mesh_area > 0.f)
+		mesh_centroid /= mesh_area;
+
+	std::vector<cluster> clusters;
+	for (std::size_t c = 0; c + 1 < boundaries.size(); ++c)
+	{
+		glm::vec3 centroid(0.f);
+		glm::vec3 normal(0.f);
+		float area_sum = 0.f;
+		for (std::size_t t = boundaries[c]; t < boundaries[c + 1]; ++t)
+		{
+			glm::vec3 const n = glm::cross(triangle_position(t, 1) - triangle_position(t, 0), triangle_position(t, 2) - triangle_position(t, 0));
+			float const area = glm::length(n);
+			centroid += area * (triangle_position(t, 0) + triangle_position(t, 1) + triangle_position(t, 2));
+			area_sum += 3.f * area;
+			normal += n;
+		}
+
+		float key = 0.f;
+		float const normal_length = glm::length(normal);
+		if (area_sum > 0.f && normal_length > 0.f)
+			key = glm::dot(centroid / area_sum - mesh_centroid, normal / normal_length);
+		clusters.push_back({boundaries[c], boundaries[c + 1], key});
+	}
+
+	std::stable_sort(clusters.begin(), clusters.end(), [](cluster const & a, cluster const & b){ return a.key > b.key; });
+
+	std::vector<std::uint32_t> result;
+	result.reserve(3 * triangle_count);
+	for (auto const & c : clusters)
+		result.insert(result.end(), indices.begin() + 3 * c.begin, indices.begin() + 3 * c.end);
+	std::copy(result.begin(), result.end(), indices.begin());
+}
+
+std::vector<std::uint32_t> optimize_vertex_fetch(std::span<std::uint32_t> indices, std::size_t vertex_count)
+{
+	static constexpr std::uint32_t unused = -1;
+
+	std::vector<std::uint32_t> remap(vertex_count, unused);
+	std::uint32_t next = 0;
+	for (auto & index : indices)
+	{
+		if (remap[index] == unused)
+			remap[index] = next++;
+		index = remap[index];
+	}
+
+	for (auto & r : remap)
+		if (r == unused)
+			r = next++;
+
+	return remap;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Triangle and vertex orders for the GPU's caches. The index ranges can be
+// parts of a larger index buffer, e.g. meshlets, which keep their triangles
+
+// Vertex shader runs per triangle with a FIFO post-transform cache of
+// cache_size vertices: 3 at worst, about 0.6-0.7 for well ordered meshes
+float average_cache_miss_ratio(std::span<std::uint32_t const> indices, int cache_size = 16);
+
+// Tipsify [Sander, Nehab, Barczak 2007]: fans around recently used vertices
+// that are likely to still be in the cache
+void optimize_vertex_cache(std::span<std::uint32_t> indices, int cache_size = 16);
+
+// Cuts the cache order into clusters and sorts them outwards-facing first,
+// so that the first drawn occlude the rest; threshold is how much the ACMR
+// may grow for clusters small enough to sort
+void optimize_overdraw(std::span<std::uint32_t> indices, std::vector<glm::vec3> const & positions, int cache_size = 16, float threshold = 1.05f);
+
+// Renumbers the vertices in the order of their first use, the unused ones
+// last, so that they are fetched sequentially; returns the new number of
+// each vertex for remap_vertices
+std::vector<std::uint32_t> optimize_vertex_fetch(std::span<std::uint32_t> indices, std::size_t vertex_count);
+
+template <typename Vertex>
+void remap_vertices(std::vector<Vertex> & vertices, std::vector<std::uint32_t> const & remap)
+{
+	std::vector<Vertex> result(vertices.size());
+	for (std::size_t i = 0; i < vertices.size(); ++i)
+		result[remap[i]] = vertices[i];
+	vertices = std::move(result);
+}
@@ -1,12 +1,39 @@
 #include "mesh_utils.hpp"
+#include "mesh_optimizer.hpp"
 
 #include <glm/common.hpp>
 #include <glm/geometric.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <sstream>
 #include <stdexcept>
+#include <string>
+#include <thread>
 
-std::pair<std::vector<vertex>, std::vector<std::uint32_t>> load_obj(std::istream & input, float scale)
+namespace
+{
+
+	// Splits [0, count) into a contiguous range per core
+	template <typename Function>
+	void parallel_for(std::size_t count, Function && function)
+	{
+		std::size_t const thread_count = std::max<std::size_t>(1, std::min<std::size_t>(std::thread::hardware_concurrency(), count / 4096));
+
+		std::vector<std::thread> threads;
+		for (std::size_t i = 1; i < thread_count; ++i)
+			threads.emplace_back([&, i]{ function(count * i / thread_count, count * (i + 1) / thread_count); });
+
+		function(0, count / thread_count);
+
+		for (auto & thread : threads)
+			thread.join();
+	}
+
+}
+
+std::pair<std::vector<vertex>, std::vector<std::uint32_t>> load_obj(std::istream & input, float scale, bool optimize)
 {
 	std::vector<vertex> vertices;
 	std::vector<std::uint32_t> indices;
@@ -15,19 +42,13 @@ std::pair<std::vector<vertex>, std::vector<std::uint32_t>> load_obj(std::istream
 	{
 		std::istringstream line_stream(line);
 
-		char type;
+		std::string type;
 		line_stream >> type;
 
-		if (type == '#')
-			continue;
-
-		if (type == 'o')
+		if (type.empty() || type[0] == '#')
 			continue;
 
-		if (type == 's')
-			continue;
-
-		if (type == 'v')
+		if (type == "v")
 		{
 			vertex v;
 			line_stream >> v.position.x >> v.position.y >> v.position.z;
@@ -36,20 +57,41 @@ std::pair<std::vector<vertex>, std::vector<std::uint32_t>> load_obj(std::istream
 			continue;
 		}
 
-		if (type == 'f')
+		if (type == "f")
 		{
-			std::uint32_t i0, i1, i2;
-			line_stream >> i0 >> i1 >> i2;
-			--i0;
-			--i1;
-			--i2;
-			indices.push_back(i0);
-			indices.push_back(i1);
-			indices.push_back(i2);
+			// Only the position of "v/vt/vn" corners, negative ones counting
+			// back from the last vertex; polygons are split into a fan
+			std::vector<std::uint32_t> corners;
+			for (std::string corner; line_stream >> corner;)
+			{
+				long const index = std::stol(corner);
+				if (index == 0 || (index > 0 ? std::size_t(index) > vertices.size() : std::size_t(-index) > vertices.size()))
+					throw std::runtime_error("OBJ face refers to a missing vertex: " + corner);
+				corners.push_back(index > 0 ? index - 1 : vertices.size() + index);
+			}
+			for (std::size_t i = 2; i < corners.size(); ++i)
+			{
+				indices.push_back(corners[0]);
+				indices.push_back(corners[i - 1]);
+				indices.push_back(corners[i]);
+			}
 			continue;
 		}
 
-		throw std::runtime_error("Unknown OBJ row type: " + std::string(1, type));
+		// Normals are recomputed by fill_normals; texture coordinates,
+		// objects, groups, smoothing and materials are of no use here
+	}
+
+	if (optimize)
+	{
+		std::vector<glm::vec3> positions;
+		positions.reserve(vertices.size());
+		for (auto const & v : vertices)
+			positions.push_back(v.position);
+
+		optimize_vertex_cache(indices);
+		optimize_overdraw(indices, positions);
+		remap_vertices(vertices, optimize_vertex_fetch(indices, vertices.size()));
 	}
 
 	return {vertices, indices};
@@ -71,23 +113,77 @@ std::pair<glm::vec3, glm::vec3> bbox(std::vector<vertex> const & vertices)
 	return {min, max};
 }
 
-void fill_normals(std::vector<vertex> & vertices, std::vector<std::uint32_t> const & indices)
+vertex_adjacency build_vertex_adjacency(std::size_t vertex_count, std::vector<std::uint32_t> const & indices)
+{
+	vertex_adjacency result;
+	result.offsets.assign(vertex_count + 1, 0);
+	for (auto i : indices)
+		++result.offsets[i + 1];
+	for (std::size_t v = 0; v < vertex_count; ++v)
+		result.offsets[v + 1] += result.offsets[v];
+
+	result.corners.resize(indices.size());
+	std::vector<std::uint32_t> next(result.offsets.begin(), result.offsets.end() - 1);
+	for (std::uint32_t c = 0; c < indices.size(); ++c)
+		result.corners[next[indices[c]]++] = c;
+
+	return result;
+}
+
+void fill_normals(std::vector<vertex> & vertices, std::vector<std::uint32_t> const & indices, vertex_adjacency const & adjacency, normal_weighting weighting)
 {
-	for (auto & v : vertices)
-		v.normal = glm::vec3(0.f);
+	std::size_t const triangle_count = indices.size() / 3;
+	bool const by_angle = (weighting == normal_weighting::angle);
+
+	// Face normals scaled by their doubled area, in separate arrays so that
+	// the gather reads only floats it sums; by angle, every corner also
+	// gets its angle over that area
+	std::vector<float> face_x(triangle_count), face_y(triangle_count), face_z(triangle_count);
+	std::vector<float> corner_weights(by_angle ? indices.size() : 0);
 
-	for (std::size_t i = 0; i < indices.size(); i += 3)
+	parallel_for(triangle_count, [&](std::size_t begin, std::size_t end)
 	{
-		auto & v0 = vertices[indices[i + 0]];
-		auto & v1 = vertices[indices[i + 1]];
-		auto & v2 = vertices[indices[i + 2]];
-
-		glm::vec3 n = glm::cross(v1.position - v0.position, v2.position - v0.position);
-		v0.normal += n;
-		v1.normal += n;
-		v2.normal += n;
-	}
+		for (std::size_t t = begin; t < end; ++t)
+		{
+			glm::vec3 const p0 = vertices[indices[3 * t + 0]].position;
+			glm::vec3 const p1 = vertices[indices[3 * t + 1]].position;
+			glm::vec3 const p2 = vertices[indices[3 * t + 2]].position;
+
+			glm::vec3 const n = glm::cross(p1 - p0, p2 - p0);
+			face_x[t] = n.x;
+			face_y[t] = n.y;
+			face_z[t] = n.z;
+
+			if (by_angle)
+			{
+				// |e0 x e1| is the same doubled area at every corner
+				float const length = glm::length(n);
+				float const inverse_length = (length > 0.f) ? 1.f / length : 0.f;
+				corner_weights[3 * t + 0] = std::atan2(length, glm::dot(p1 - p0, p2 - p0)) * inverse_length;
+				corner_weights[3 * t + 1] = std::atan2(length, glm::dot(p2 - p1, p0 - p1)) * inverse_length;
+				corner_weights[3 * t + 2] = std::atan2(length, glm::dot(p0 - p2, p1 - p2)) * inverse_length;
+			}
+		}
+	});
 
-	for (auto & v : vertices)
-		v.normal = glm::normalize(v.normal);
+	parallel_for(vertices.size(), [&](std::size_t begin, std::size_t end)
+	{
+		for (std::size_t v = begin; v < end; ++v)
+		{
+			glm::vec3 sum(0.f);
+			for (std::uint32_t i = adjacency.offsets[v]; i < adjacency.offsets[v + 1]; ++i)
+			{
+				std::uint32_t const c = adjacency.corners[i];
+				std::uint32_t const t = c / 3;
+				float const w = by_angle ? corner_weights[c] : 1.f;
+				sum += w * glm::vec3(face_x[t], face_y[t], face_z[t]);
+			}
+			vertices[v].normal = glm::normalize(sum);
+		}
+	});
+}
+
+void fill_normals(std::vector<vertex> & vertices, std::vector<std::uint32_t> const & indices, normal_weighting weighting)
+{
+	fill_normals(vertices, indices, build_vertex_adjacency(vertices.size(), indices), weighting);
 }
@@ -2,6 +2,7 @@
 
 #include <glm/vec3.hpp>
 
+#include <cstdint>
 #include <utility>
 #include <vector>
 #include <iostream>
@@ -12,8 +13,36 @@ struct vertex
 	glm::vec3 normal;
 };
 
-std::pair<std::vector<vertex>, std::vector<std::uint32_t>> load_obj(std::istream & input, float scale = 1.f);
+// Only the v and f rows are read, the rest skipped. With optimize, the
+// triangles are reordered for the post-transform cache and overdraw and the
+// vertices for fetching (see mesh_optimizer.hpp)
+std::pair<std::vector<vertex>, std::vector<std::uint32_t>> load_obj(std::istream & input, float scale = 1.f, bool optimize = false);
 
 std::pair<glm::vec3, glm::vec3> bbox(std::vector<vertex> const & vertices);
 
-void fill_normals(std::vector<vertex> & vertices, std::vector<std::uint32_t> const & indices);
+enum class normal_weighting
+{
+	// Faces count by their area
+	area,
+	// Faces count by their angle at the vertex, which doesn't depend on how
+	// the surface around it is triangulated [Thurmer, Wuthrich 1998]
+	angle,
+};
+
+// The triangle corners (positions in indices) of every vertex, for gathering
+// per-corner values into vertices without two threads writing to one
+struct vertex_adjacency
+{
+	// Vertex v's corners are corners[offsets[v]] to corners[offsets[v + 1]]
+	std::vector<std::uint32_t> offsets;
+	std::vector<std::uint32_t> corners;
+};
+
+vertex_adjacency build_vertex_adjacency(std::size_t vertex_count, std::vector<std::uint32_t> const & indices);
+
+// On all cores: the weighted normals of all the corners, then their sums
+// per vertex through the adjacency, which can be built once for a mesh that
+// only moves
+void fill_normals(std::vector<vertex> & vertices, std::vector<std::uint32_t> const & indices, vertex_adjacency const & adjacency, normal_weighting weighting = normal_weighting::area);
+
+void fill_normals(std::vector<vertex> & vertices, std::vector<std::uint32_t> const & indices, normal_weighting weighting = normal_weighting::area);
@@ -0,0 +1,246 @@
+#include "meshlets.hpp"
+#include "aabb.hpp"
+#include "intersect.hpp"
+
+#include <glm/geometric.hpp>
+#include <glm/common.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+std::vector<meshlet> build_meshlets(std::vector<glm::vec3> const & positions, std::vector<std::uint32_t> & indices, std::uint32_t first, std::uint32_t count, std::uint32_t max_triangles)
+{
+	static const float inf = std::numeric_limits<float>::infinity();
+
+	std::uint32_t const triangle_count = count / 3;
+
+	std::vector<std::array<std::uint32_t, 3>> triangles(triangle_count);
+	std::vector<glm::vec3> centers(triangle_count);
+	// Zero for the degenerate triangles, which face nowhere
+	std::vector<glm::vec3> normals(triangle_count);
+	for (std::uint32_t t = 0; t < triangle_count; ++t)
+	{
+		auto const * i = indices.data() + first + 3 * t;
+		triangles[t] = {i[0], i[1], i[2]};
+
+		glm::vec3 const & p0 = positions[i[0]];
+		glm::vec3 const & p1 = positions[i[1]];
+		glm::vec3 const & p2 = positions[i[2]];
+		centers[t] = (p0 + p1 + p2) / 3.f;
+
+		glm::vec3 const n = glm::cross(p1 - p0, p2 - p0);
+		float const length = glm::length(n);
+		normals[t] = (length > 0.f) ? n / length : glm::vec3(0.f);
+	}
+
+	// OBJ vertices are split wherever the normals or texture coordinates
+	// are, so triangles are neighbours when they share a position
+	std::vector<std::uint32_t> welded(positions.size());
+	{
+		std::unordered_map<std::uint64_t, std::uint32_t> first_at;
+		for (std::uint32_t v = 0; v < positions.size(); ++v)
+		{
+			std::uint32_t bits[3];
+			std::memcpy(bits, &positions[v], sizeof(bits));
+			std::uint64_t const key = (std::uint64_t(bits[0]) * 0x9e3779b97f4a7c15ull) ^ (std::uint64_t(bits[1]) * 0xc2b2ae3d27d4eb4full) ^ bits[2];
+
+			auto [it, inserted] = first_at.try_emplace(key, v);
+			// Keys of different positions may collide; those stay apart
+			welded[v] = (inserted || positions[it->second] != positions[v]) ? v : it->second;
+		}
+	}
+
+	// The triangles around each welded vertex
+	std::vector<std::uint32_t> vertex_offsets(positions.size() + 1, 0);
+	for (auto const & triangle : triangles)
+		for (auto v : triangle)
+			++vertex_offsets[welded[v] + 1];
+	for (std::size_t v = 0; v < positions.size(); ++v)
+		vertex_offsets[v + 1] += vertex_offsets[v];
+
+	std::vector<std::uint32_t> vertex_triangles(vertex_offsets.back());
+	{
+		std::vector<std::uint32_t> fill(vertex_offsets.begin(), vertex_offsets.end() - 1);
+		for (std::uint32_t t = 0; t < triangle_count; ++t)
+			for (auto v : triangles[t])
+				vertex_triangles[fill[welded[v]]++] = t;
+	}
+
+	std::vector<meshlet> result;
+	std::vector<std::uint32_t> order;
+	order.reserve(triangle_count);
+
+	std::vector<bool> assigned(triangle_count, false);
+	// The meshlet each triangle was last put on the frontier for
+	std::vector<std::uint32_t> seen(triangle_count, std::uint32_t(-1));
+	std::vector<std::uint32_t> frontier;
+
+	auto free_neighbours = [&](std::uint32_t t)
+	{
+		int count = 0;
+		for (auto v : triangles[t])
+			for (auto j = vertex_offsets[welded[v]]; j < vertex_offsets[welded[v] + 1]; ++j)
+				count += !assigned[vertex_triangles[j]];
+		return count;
+	};
+
+	std::uint32_t next_unassigned = 0;
+	while (order.size() < triangle_count)
+	{
+		// Carry on from the last meshlet's border where it has free triangles
+		// left, taking the most enclosed one so that no islands are left
+		// behind; otherwise from the index buffer's order
+		std::uint32_t seed = std::uint32_t(-1);
+		int seed_neighbours = std::numeric_limits<int>::max();
+		for (auto t : frontier)
+		{
+			int const n = free_neighbours(t);
+			if (n < seed_neighbours)
+			{
+				seed = t;
+				seed_neighbours = n;
+			}
+		}
+
+		if (seed == std::uint32_t(-1))
+		{
+			while (assigned[next_unassigned])
+				++next_unassigned;
+			seed = next_unassigned;
+		}
+
+		std::uint32_t const id = result.size();
+		std::uint32_t const begin = order.size();
+
+		glm::vec3 center_sum(0.f);
+		glm::vec3 normal_sum(0.f);
+
+		auto add = [&](std::uint32_t t)
+		{
+			assigned[t] = true;
+			order.push_back(t);
+			center_sum += centers[t];
+			normal_sum += normals[t];
+
+			for (auto v : triangles[t])
+			{
+				v = welded[v];
+				for (auto j = vertex_offsets[v]; j < vertex_offsets[v + 1]; ++j)
+				{
+					std::uint32_t const n = vertex_triangles[j];
+					if (!assigned[n] && seen[n] != id)
+					{
+						seen[n] = id;
+						frontier.push_back(n);
+					}
+				}
+			}
+		};
+
+		frontier.clear();
+		seen[seed] = id;
+		add(seed);
+
+		while (order.size() - begin < max_triangles && !frontier.empty())
+		{
+			glm::vec3 const center = center_sum / float(order.size() - begin);
+			float const normal_length = glm::length(normal_sum);
+			glm::vec3 const normal = (normal_length > 0.f) ? normal_sum / normal_length : glm::vec3(0.f);
+
+			// Distance to the meshlet, up to nine times as far for the
+			// triangles facing the other way, and as many times as they have
+			// free neighbours: the enclosed ones go first rather than being
+			// left behind as islands
+			std::size_t best = 0;
+			float best_score = inf;
+			for (std::size_t j = 0; j < frontier.size(); ++j)
+			{
+				std::uint32_t const t = frontier[j];
+				float const facing = 2.f - glm::dot(normals[t], normal);
+				float const score = glm::length(centers[t] - center) * facing * facing * float(free_neighbours(t));
+				if (score < best_score)
+				{
+					best = j;
+					best_score = score;
+				}
+			}
+
+			std::uint32_t const t = frontier[best];
+			frontier[best] = frontier.back();
+			frontier.pop_back();
+			add(t);
+		}
+
+		std::uint32_t const end = order.size();
+
+		glm::vec3 min(inf), max(-inf);
+		for (auto j = begin; j < end; ++j)
+		{
+			for (auto v : triangles[order[j]])
+			{
+				min = glm::min(min, positions[v]);
+				max = glm::max(max, positions[v]);
+			}
+		}
+
+		meshlet m;
+		m.first = first + 3 * begin;
+		m.count = 3 * (end - begin);
+		m.center = (min + max) * 0.5f;
+		m.radius = 0.f;
+		for (auto j = begin; j < end; ++j)
+			for (auto v : triangles[order[j]])
+				m.radius = std::max(m.radius, glm::length(positions[v] - m.center));
+
+		float const normal_length = glm::length(normal_sum);
+		m.cone_axis = (normal_length > 0.f) ? normal_sum / normal_length : glm::vec3(0.f, 0.f, 1.f);
+
+		// The cone holds the normals within acos(min_dot) of its axis; all of
+		// them face away when the view directions are within 90 degrees minus
+		// that, i.e. their cosine to the axis is above sin(acos(min_dot))
+		float min_dot = 1.f;
+		for (auto j = begin; j < end; ++j)
+			if (normals[order[j]] != glm::vec3(0.f))
+				min_dot = std::min(min_dot, glm::dot(normals[order[j]], m.cone_axis));
+		m.cone_cutoff = (normal_length > 0.f && min_dot > 0.f) ? std::sqrt(1.f - min_dot * min_dot) : 1.f;
+
+		result.push_back(m);
+	}
+
+	for (std::uint32_t t = 0; t < triangle_count; ++t)
+		std::copy(triangles[order[t]].begin(), triangles[order[t]].end(), indices.begin() + first + 3 * t);
+
+	return result;
+}
+
+bool meshlet_backfacing(meshlet const & m, glm::vec3 const & camera_position)
+{
+	glm::vec3 const direction = m.center - camera_position;
+	return glm::dot(direction, m.cone_axis) >= m.cone_cutoff * glm::length(direction) + m.radius;
+}
+
+void cull_meshlets(std::vector<meshlet> const & meshlets, frustum const & f, glm::vec3 const & camera_position, std::vector<std::int32_t> & counts, std::vector<void const *> & offsets)
+{
+	counts.clear();
+	offsets.clear();
+
+	std::uint32_t end = std::uint32_t(-1);
+	for (auto const & m : meshlets)
+	{
+		if (meshlet_backfacing(m, camera_position) || !f.intersects(m.center - m.radius, m.center + m.radius))
+			continue;
+
+		if (m.first == end)
+			counts.back() += m.count;
+		else
+		{
+			counts.push_back(m.count);
+			offsets.push_back(reinterpret_cast<void const *>(std::uintptr_t(m.first) * sizeof(std::uint32_t)));
+		}
+		end = m.first + m.count;
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "frustum.hpp"
+
+#include <glm/vec3.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// A small connected patch of triangles, a run of the index buffer, with the
+// bounds to cull it by before it is drawn
+struct meshlet
+{
+	std::uint32_t first;
+	std::uint32_t count;
+
+	glm::vec3 center;
+	float radius;
+
+	// Every triangle faces away from the cameras with
+	// dot(center - camera, cone_axis) >= cone_cutoff * |center - camera| + radius;
+	// cone_cutoff is 1 when the normals are too spread for that to happen
+	glm::vec3 cone_axis;
+	float cone_cutoff;
+};
+
+// Reorders the triangles of indices[first, first + count) into meshlets of at
+// most max_triangles, grown over shared vertices from the triangles closest
+// to the meshlet and facing the same way, seeded in the order of the index
+// buffer. Works with any vertex layout through the positions alone
+std::vector<meshlet> build_meshlets(std::vector<glm::vec3> const & positions, std::vector<std::uint32_t> & indices, std::uint32_t first, std::uint32_t count, std::uint32_t max_triangles = 128);
+
+bool meshlet_backfacing(meshlet const & m, glm::vec3 const & camera_position);
+
+// Merged runs of the meshlets intersecting the frustum (by their spheres'
+// boxes) and not facing away from the camera, in the form glMultiDrawElements
+// takes them: counts in indices, offsets in bytes
+void cull_meshlets(std::vector<meshlet> const & meshlets, frustum const & f, glm::vec3 const & camera_position, std::vector<std::int32_t> & counts, std::vector<void const *> & offsets);
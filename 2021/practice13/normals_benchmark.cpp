@@ -0,0 +1,127 @@
+#include "mesh_utils.hpp"
+
+#include <glm/geometric.hpp>
+#include <glm/trigonometric.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Usage: normals_benchmark [file.obj ...]
+// Times fill_normals against the single-threaded loop it replaced on the
+// given files (bunny0.obj by default; e.g. 2022/practice6/dragon.obj for a
+// bigger one), with and without building the adjacency, and checks that the
+// area-weighted normals match
+
+namespace
+{
+
+	void fill_normals_serial(std::vector<vertex> & vertices, std::vector<std::uint32_t> const & indices)
+	{
+		for (auto & v : vertices)
+			v.normal = glm::vec3(0.f);
+
+		for (std::size_t i = 0; i < indices.size(); i += 3)
+		{
+			auto & v0 = vertices[indices[i + 0]];
+			auto & v1 = vertices[indices[i + 1]];
+			auto & v2 = vertices[indices[i + 2]];
+
+			glm::vec3 n = glm::cross(v1.position - v0.position, v2.position - v0.position);
+			v0.normal += n;
+			v1.normal += n;
+			v2.normal += n;
+		}
+
+		for (auto & v : vertices)
+			v.normal = glm::normalize(v.normal);
+	}
+
+	// Best of several runs, in milliseconds
+	template <typename Function>
+	float measure(Function && function)
+	{
+		int const runs = 20;
+
+		float best = 0.f;
+		for (int i = 0; i < runs; ++i)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			function();
+			auto end = std::chrono::high_resolution_clock::now();
+
+			float ms = std::chrono::duration_cast<std::chrono::duration<float, std::milli>>(end - start).count();
+			if (i == 0 || ms < best)
+				best = ms;
+		}
+		return best;
+	}
+
+	// The largest angle between two sets of normals, in degrees
+	float max_angle(std::vector<vertex> const & a, std::vector<vertex> const & b)
+	{
+		float result = 0.f;
+		for (std::size_t i = 0; i < a.size(); ++i)
+			if (float const d = glm::dot(a[i].normal, b[i].normal); d == d)
+				result = std::max(result, std::acos(std::min(1.f, d)));
+		return glm::degrees(result);
+	}
+
+}
+
+int main(int argc, char ** argv) try
+{
+	std::vector<std::string> paths;
+	for (int i = 1; i < argc; ++i)
+		paths.push_back(argv[i]);
+
+	if (paths.empty())
+		paths.push_back(PRACTICE_SOURCE_DIRECTORY "/bunny0.obj");
+
+	bool ok = true;
+
+	for (auto const & path : paths)
+	{
+		std::ifstream in(path);
+		if (!in)
+			throw std::runtime_error("Failed to open " + path);
+		auto [vertices, indices] = load_obj(in);
+
+		auto serial = vertices;
+		auto parallel = vertices;
+		auto angle = vertices;
+
+		auto const adjacency = build_vertex_adjacency(vertices.size(), indices);
+
+		float serial_ms = measure([&]{ fill_normals_serial(serial, indices); });
+		float adjacency_ms = measure([&]{ build_vertex_adjacency(vertices.size(), indices); });
+		float parallel_ms = measure([&]{ fill_normals(parallel, indices, adjacency); });
+		float angle_ms = measure([&]{ fill_normals(angle, indices, adjacency, normal_weighting::angle); });
+
+		// Only the order of the sums differs
+		float const error = max_angle(serial, parallel);
+		bool const equal = error < 0.1f;
+		ok = ok && equal;
+
+		std::cout << path << ": "
+			<< vertices.size() << " vertices, "
+			<< indices.size() / 3 << " triangles\n"
+			<< "    serial:          " << serial_ms << " ms\n"
+			<< "    adjacency:       " << adjacency_ms << " ms, once per mesh\n"
+			<< "    parallel, area:  " << parallel_ms << " ms (x" << serial_ms / parallel_ms << ")\n"
+			<< "    parallel, angle: " << angle_ms << " ms, up to " << max_angle(parallel, angle) << " degrees from area\n"
+			<< "    results " << (equal ? "match" : "DIFFER") << " (" << error << " degrees)" << std::endl;
+	}
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch (std::exception const & e)
+{
+	std::cerr << e.what() << std::endl;
+	return EXIT_FAILURE;
+}
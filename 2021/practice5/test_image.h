@@ -1,3 +1,4 @@
-extern unsigned char * test_image;
+// 887x887 RGB8, rows top to bottom, compiled in from test_image.rgb
+extern unsigned char const * test_image;
 extern unsigned int test_image_width;
 extern unsigned int test_image_height;
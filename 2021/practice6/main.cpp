@@ -214,7 +214,10 @@ int main() try
 	glBindTexture(GL_TEXTURE_2D, brick_albedo);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, brick_albedo_width, brick_albedo_height, 0, GL_RGB, GL_UNSIGNED_BYTE, brick_albedo_data);
+	{
+		auto const pixels = load_brick_albedo();
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, brick_texture_width, brick_texture_height, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels.data().data());
+	}
 	glGenerateMipmap(GL_TEXTURE_2D);
 
 	auto last_frame_start = std::chrono::high_resolution_clock::now();
@@ -0,0 +1,13 @@
+#include "resource.hpp"
+
+#include <cstdlib>
+
+resource::resource(std::span<unsigned char const> embedded, std::filesystem::path const & path)
+	: data_(embedded)
+{
+	if (RESOURCES_EMBEDDED && !std::getenv("RESOURCES_FROM_FILES"))
+		return;
+
+	file_.emplace(path);
+	data_ = {reinterpret_cast<unsigned char const *>(file_->data()), file_->size()};
+}
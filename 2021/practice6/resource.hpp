@@ -0,0 +1,60 @@
+#pragma once
+
+#include "mapped_file.hpp"
+
+#include <filesystem>
+#include <optional>
+#include <span>
+
+// EMBED_RESOURCE(name, path), at namespace scope in a .cpp, compiles the file
+// at the given absolute path into the executable as it is, through the
+// assembler's .incbin, so it builds in no time whatever the file's size.
+// It declares name_begin and name_end around the bytes. Where there is no
+// GNU-style assembler (MSVC) nothing is embedded, and resources are always
+// loaded from their files
+#if defined(__GNUC__) && (defined(__ELF__) || defined(__APPLE__))
+#define RESOURCES_EMBEDDED 1
+
+#ifdef __APPLE__
+#define RESOURCE_SECTION "__DATA,__const"
+#define RESOURCE_SYMBOL(name) "_" #name
+#else
+#define RESOURCE_SECTION ".rodata"
+#define RESOURCE_SYMBOL(name) #name
+#endif
+
+#define EMBED_RESOURCE(name, path) \
+	__asm__( \
+		".pushsection " RESOURCE_SECTION "\n" \
+		".global " RESOURCE_SYMBOL(name##_begin) "\n" \
+		".global " RESOURCE_SYMBOL(name##_end) "\n" \
+		".balign 16\n" \
+		RESOURCE_SYMBOL(name##_begin) ":\n" \
+		".incbin \"" path "\"\n" \
+		RESOURCE_SYMBOL(name##_end) ":\n" \
+		".byte 0\n" \
+		".popsection\n"); \
+	extern "C" unsigned char const name##_begin[]; \
+	extern "C" unsigned char const name##_end[];
+
+#define RESOURCE_SPAN(name) std::span<unsigned char const>(name##_begin, name##_end)
+#else
+#define RESOURCES_EMBEDDED 0
+#define EMBED_RESOURCE(name, path)
+#define RESOURCE_SPAN(name) std::span<unsigned char const>()
+#endif
+
+// The bytes of a resource: its embedded copy, or its file memory-mapped at
+// runtime when nothing is embedded or the RESOURCES_FROM_FILES environment
+// variable is set, so that the file can be changed without rebuilding
+class resource
+{
+public:
+	resource(std::span<unsigned char const> embedded, std::filesystem::path const & path);
+
+	std::span<unsigned char const> data() const { return data_; }
+
+private:
+	std::optional<mapped_file> file_;
+	std::span<unsigned char const> data_;
+};
@@ -0,0 +1,27 @@
+#include "textures.hpp"
+
+#include <stdexcept>
+
+namespace
+{
+
+	resource load_brick_texture(std::span<unsigned char const> embedded, std::filesystem::path const & path)
+	{
+		resource result(embedded, path);
+		if (result.data().size() != std::size_t(brick_texture_width) * brick_texture_height * 3)
+			throw std::runtime_error(path.string() + " doesn't match the brick texture size");
+		return result;
+	}
+
+}
+
+#define BRICK_TEXTURE(name) \
+	EMBED_RESOURCE(name##_rgb, PRACTICE_SOURCE_DIRECTORY "/textures/raw/" #name ".rgb") \
+	resource load_##name() \
+	{ \
+		return load_brick_texture(RESOURCE_SPAN(name##_rgb), PRACTICE_SOURCE_DIRECTORY "/textures/raw/" #name ".rgb"); \
+	}
+
+BRICK_TEXTURE(brick_albedo)
+BRICK_TEXTURE(brick_normal)
+BRICK_TEXTURE(brick_orm)
@@ -1,15 +1,14 @@
-extern unsigned char brick_albedo_data[];
-extern unsigned int brick_albedo_width;
-extern unsigned int brick_albedo_height;
+#pragma once
 
-extern unsigned char brick_normal_data[];
-extern unsigned int brick_normal_width;
-extern unsigned int brick_normal_height;
+#include "resource.hpp"
 
-extern unsigned char brick_roughness_data[];
-extern unsigned int brick_roughness_width;
-extern unsigned int brick_roughness_height;
+// The brick textures, RGB8, rows top to bottom. They are compiled in from
+// textures/raw; see resource.hpp for when they are mapped from there instead
+constexpr unsigned int brick_texture_width = 1024;
+constexpr unsigned int brick_texture_height = 1024;
 
-extern unsigned char brick_ao_data[];
-extern unsigned int brick_ao_width;
-extern unsigned int brick_ao_height;
+resource load_brick_albedo();
+resource load_brick_normal();
+// Ambient occlusion, roughness and metalness in R, G and B, packed from what
+// were two textures of three equal channels
+resource load_brick_orm();